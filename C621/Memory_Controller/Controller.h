@@ -3,16 +3,29 @@
 
 #include "Bank.h"
 #include "Queue.h"
+#include "Heap.h"
 
 // Bank
 extern void initBank(Bank *bank);
 
 // Queue operations
-extern Queue* initQueue();
+extern Node_Pool* initNodePool(unsigned capacity);
+extern Node *allocNode(Node_Pool *pool);
+extern void releaseNode(Node_Pool *pool, Node *node);
+extern Queue* initQueue(Node_Pool *pool);
 extern void pushToQueue(Queue *q, Request *req);
-extern void migrateToQueue(Queue *q, Node *_node);
+extern void removeNode(Queue *q, Node *node);
 extern void deleteNode(Queue *q, Node *node);
 
+// Heap operations
+extern Heap* initHeap(unsigned capacity);
+extern Node *topOfHeap(Heap *heap);
+extern void pushToHeap(Heap *heap, Node *node);
+extern Node *popFromHeap(Heap *heap);
+
+// Simulation mode
+#define EVENT_DRIVEN // Skip the memory cycles where tick() has nothing to do
+
 // CONSTANTS
 static unsigned MAX_WAITING_QUEUE_SIZE = 64;
 static unsigned BLOCK_SIZE = 128; // cache block size
@@ -30,11 +43,15 @@ typedef struct Controller
     // Current memory clock
     uint64_t cur_clk;
 
+    // Every node of the waiting queue and the pending heap comes from this pool.
+    Node_Pool *node_pool;
+
     // A queue contains all the requests that are waiting to be issued.
     Queue *waiting_queue;
 
-    // A queue contains all the requests that have already been issued but are waiting to complete.
-    Queue *pending_queue;
+    // A min-heap contains all the requests that have already been issued
+    // but are waiting to complete, ordered by their completion time.
+    Heap *pending_queue;
 
     /* For decoding */
     unsigned bank_shift;
@@ -52,8 +69,10 @@ Controller *initController()
     }
     controller->cur_clk = 0;
 
-    controller->waiting_queue = initQueue();
-    controller->pending_queue = initQueue();
+    // A bank serves one request at a time, so at most NUM_OF_BANKS requests are in flight.
+    controller->node_pool = initNodePool(MAX_WAITING_QUEUE_SIZE + NUM_OF_BANKS);
+    controller->waiting_queue = initQueue(controller->node_pool);
+    controller->pending_queue = initHeap(NUM_OF_BANKS);
 
     controller->bank_shift = log2(BLOCK_SIZE);
     controller->bank_mask = (uint64_t)NUM_OF_BANKS - (uint64_t)1;
@@ -85,6 +104,55 @@ bool send(Controller *controller, Request *req)
     return true;
 }
 
+// The earliest memory clock at which tick() can change the controller state: the
+// first pending request finishes or the first waiting request can be issued.
+uint64_t nextEvent(Controller *controller)
+{
+    uint64_t next_clk = UINT64_MAX;
+
+    if (controller->pending_queue->size)
+    {
+        next_clk = topOfHeap(controller->pending_queue)->end_exe;
+    }
+
+    if (controller->waiting_queue->size)
+    {
+        Node *first = controller->waiting_queue->first;
+        uint64_t issue_clk = (controller->bank_status)[first->bank_id].next_free;
+        if (issue_clk < next_clk)
+        {
+            next_clk = issue_clk;
+        }
+    }
+
+    if (next_clk == UINT64_MAX || next_clk <= controller->cur_clk)
+    {
+        next_clk = controller->cur_clk + 1;
+    }
+
+    return next_clk;
+}
+
+// Advance the controller clock so that the next tick() lands exactly on target_clk.
+// Returns the number of memory cycles that have been skipped.
+uint64_t fastForward(Controller *controller, uint64_t target_clk)
+{
+    if (target_clk <= controller->cur_clk + 1)
+    {
+        return 0;
+    }
+
+    uint64_t skipped = target_clk - 1 - controller->cur_clk;
+
+    controller->cur_clk += skipped;
+    for (int i = 0; i < NUM_OF_BANKS; i++)
+    {
+        (controller->bank_status)[i].cur_clk += skipped;
+    }
+
+    return skipped;
+}
+
 void tick(Controller *controller)
 {
     // Step one, update system stats
@@ -97,21 +165,19 @@ void tick(Controller *controller)
     }
     // printf("\n");
 
-    // Step two, serve pending requests
-    if (controller->pending_queue->size)
+    // Step two, serve pending requests, all the requests finished by now retire in this cycle
+    while (controller->pending_queue->size &&
+           topOfHeap(controller->pending_queue)->end_exe <= controller->cur_clk)
     {
-        Node *first = controller->pending_queue->first;
-        if (first->end_exe <= controller->cur_clk)
-        {
-            /*
-            printf("Clk: ""%"PRIu64"\n", controller->cur_clk);
-            printf("Address: ""%"PRIu64"\n", first->mem_addr);
-            printf("Bank ID: %d\n", first->bank_id);
-            printf("Begin execution: ""%"PRIu64"\n", first->begin_exe);
-            printf("End execution: ""%"PRIu64"\n\n", first->end_exe);
-            */
-            deleteNode(controller->pending_queue, first);
-        }
+        Node *first = popFromHeap(controller->pending_queue);
+        /*
+        printf("Clk: ""%"PRIu64"\n", controller->cur_clk);
+        printf("Address: ""%"PRIu64"\n", first->mem_addr);
+        printf("Bank ID: %d\n", first->bank_id);
+        printf("Begin execution: ""%"PRIu64"\n", first->begin_exe);
+        printf("End execution: ""%"PRIu64"\n\n", first->end_exe);
+        */
+        releaseNode(controller->node_pool, first);
     }
 
     // Step three, find a request to schedule
@@ -135,8 +201,9 @@ void tick(Controller *controller)
             // The target bank is no longer free until this request completes.
             (controller->bank_status)[target_bank_id].next_free = first->end_exe;
 
-            migrateToQueue(controller->pending_queue, first);
-            deleteNode(controller->waiting_queue, first);
+            // No copy, the node itself moves from the waiting queue to the pending heap.
+            removeNode(controller->waiting_queue, first);
+            pushToHeap(controller->pending_queue, first);
         }
     }
 }
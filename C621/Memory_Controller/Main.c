@@ -9,6 +9,9 @@ extern Controller *initController();
 extern unsigned ongoingPendingRequests(Controller *controller);
 extern bool send(Controller *controller, Request *req);
 extern void tick(Controller *controller);
+extern void freeNodePool(Node_Pool *pool);
+extern uint64_t nextEvent(Controller *controller);
+extern uint64_t fastForward(Controller *controller, uint64_t target_clk);
 
 int main(int argc, const char *argv[])
 {	
@@ -44,13 +47,28 @@ int main(int argc, const char *argv[])
             stall = !(send(controller, mem_trace->cur_req));
         }
 
+        #ifdef EVENT_DRIVEN
+        // No new request can enter the queue, jump to the next memory cycle
+        // where tick() has work to do.
+        if (end || stall)
+        {
+            cycles += fastForward(controller, nextEvent(controller));
+        }
+        #endif
+
         tick(controller);
         ++cycles;
     }
 
+    printf("End Execution Time: ""%"PRIu64"\n", cycles);
+    // Every node comes from the preallocated pool, mallocs should stay at zero.
+    printf("Node Pool Allocations: ""%"PRIu64"\n", controller->node_pool->num_allocs);
+    printf("Node Pool Mallocs: ""%"PRIu64"\n", controller->node_pool->num_mallocs);
+
     free(controller->bank_status);
     free(controller->waiting_queue);
+    free(controller->pending_queue->nodes);
     free(controller->pending_queue);
+    freeNodePool(controller->node_pool);
     free(controller);
-    printf("End Execution Time: ""%"PRIu64"\n", cycles);
 }
@@ -28,17 +28,99 @@ typedef struct Node
     Node *next;
 }Node;
 
+// A preallocated pool of nodes, requests move between queues without touching malloc/free.
+typedef struct Node_Pool
+{
+    Node *free_list; // Free nodes, linked through their next pointers
+
+    Node **chunks; // Every block of nodes the pool has allocated
+    unsigned num_chunks;
+
+    unsigned capacity; // Total number of nodes owned by the pool
+
+    uint64_t num_allocs; // Number of nodes handed out
+    uint64_t num_mallocs; // Number of malloc calls after the initial preallocation
+}Node_Pool;
+
+// Carve a new block of nodes and thread them onto the free list
+void growNodePool(Node_Pool *pool, unsigned num_nodes)
+{
+    Node *chunk = (Node *)malloc(num_nodes * sizeof(Node));
+
+    pool->chunks = (Node **)realloc(pool->chunks, (pool->num_chunks + 1) * sizeof(Node *));
+    pool->chunks[pool->num_chunks] = chunk;
+    pool->num_chunks = pool->num_chunks + 1;
+
+    for (unsigned i = 0; i < num_nodes; i++)
+    {
+        chunk[i].next = pool->free_list;
+        pool->free_list = &chunk[i];
+    }
+    pool->capacity = pool->capacity + num_nodes;
+}
+
+Node_Pool* initNodePool(unsigned capacity)
+{
+    Node_Pool *pool = (Node_Pool *)malloc(sizeof(Node_Pool));
+
+    pool->free_list = NULL;
+    pool->chunks = NULL;
+    pool->num_chunks = 0;
+    pool->capacity = 0;
+    growNodePool(pool, capacity);
+
+    pool->num_allocs = 0;
+    pool->num_mallocs = 0;
+
+    return pool;
+}
+
+Node *allocNode(Node_Pool *pool)
+{
+    if (pool->free_list == NULL)
+    {
+        // Should never happen when the pool is sized correctly, double it.
+        growNodePool(pool, pool->capacity);
+        pool->num_mallocs = pool->num_mallocs + 1;
+    }
+
+    Node *node = pool->free_list;
+    pool->free_list = node->next;
+    pool->num_allocs = pool->num_allocs + 1;
+
+    return node;
+}
+
+void releaseNode(Node_Pool *pool, Node *node)
+{
+    node->next = pool->free_list;
+    pool->free_list = node;
+}
+
+void freeNodePool(Node_Pool *pool)
+{
+    for (unsigned i = 0; i < pool->num_chunks; i++)
+    {
+        free(pool->chunks[i]);
+    }
+    free(pool->chunks);
+    free(pool);
+}
+
 typedef struct Queue
 {
     Node *first;
     Node *last;
 
     unsigned size; // Current size of the queue
+
+    Node_Pool *pool; // Where the nodes of the queue come from
 }Queue;
 
-Queue* initQueue()
+Queue* initQueue(Node_Pool *pool)
 {
     Queue *q = (Queue *)malloc(sizeof(Queue));
+    q->pool = pool;
 
     q->first = NULL;
     q->last = NULL;
@@ -50,7 +132,7 @@ Queue* initQueue()
 // Push a request to the queue
 void pushToQueue(Queue *q, Request *req)
 {
-    Node *node = (Node *)malloc(sizeof(Node));
+    Node *node = allocNode(q->pool);
     node->mem_addr = req->memory_address;
     node->req_type = req->req_type;
     node->bank_id = req->bank_id;
@@ -94,55 +176,8 @@ void pushToQueue(Queue *q, Request *req)
     */
 }
 
-void migrateToQueue(Queue *q, Node *_node)
-{
-    Node *node = (Node *)malloc(sizeof(Node));
-    node->mem_addr = _node->mem_addr;
-    node->req_type = _node->req_type;
-    node->bank_id = _node->bank_id;
-    node->begin_exe = _node->begin_exe;
-    node->end_exe = _node->end_exe;
-
-    node->prev = NULL;
-    node->next = NULL;
-
-    // Check if the queue is empty.
-    if (q->first == NULL && q->last == NULL)
-    {
-        q->first = node;
-        q->last = node;
-        q->size = 1;
-    }
-    else
-    {
-        // Now, the new node becomes the last node of the queue.
-        node->prev = q->last;
-        q->last->next = node;
-
-        q->last = node;
-        q->size = q->size + 1;
-    }
-
-    /*
-    // print the queue
-    Node *iter = q->first;
-    while (iter != NULL)
-    {
-        printf("(""%"PRIu64, iter->mem_addr);
-        printf(" : ");
-        printf("%d)", iter->bank_id);
-
-        iter = iter->next;
-        if (iter != NULL)
-        {
-            printf(" -> ");
-        }
-    }
-    printf("\n");
-    */
-}
-
-void deleteNode(Queue *q, Node *node)
+// Unlink a node from the queue, the node itself is kept alive
+void removeNode(Queue *q, Node *node)
 {
     q->size = q->size - 1;
 
@@ -150,22 +185,16 @@ void deleteNode(Queue *q, Node *node)
     {
         q->first = NULL;
         q->last = NULL;
-
-        free(node);
     }
     else if (node == q->first && node != q->last)
     {
         q->first = node->next; // Node's next node becomes the first node
         q->first->prev = NULL;
-
-        free(node);
     }
     else if (node != q->first && node == q->last)
     {
         q->last = node->prev; // Node's previous node becomes the last node
         q->last->next = NULL;
-
-        free(node);
     }
     else
     {
@@ -174,9 +203,17 @@ void deleteNode(Queue *q, Node *node)
 
         prev->next = next;
         next->prev = prev;
-
-        free(node);
     }
+
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+void deleteNode(Queue *q, Node *node)
+{
+    removeNode(q, node);
+
+    releaseNode(q->pool, node);
 }
 
 #endif
@@ -0,0 +1,195 @@
+#ifndef __ADDRESS_MAPPING_HH__
+#define __ADDRESS_MAPPING_HH__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "Controller.h"
+
+/*
+ * Physical address mapping. An ordering lists the fields from the most significant
+ * bits down, e.g. "row:column:bank:channel". The row is always on top, the block
+ * offset always at the bottom.
+ *
+ * The column is split in two: the low column bits sit right above the block offset
+ * and set the channel interleave granularity (how many consecutive bytes stay on one
+ * channel), the rest of the column bits go where the ordering puts "column".
+ *
+ * "rank" and "group" (bank group) are optional. When the ordering leaves one out, its
+ * bits are the top bits of the bank field, e.g. "row:rank:column:bank:group:channel"
+ * spreads consecutive blocks of a channel over the bank groups first.
+ */
+typedef enum Addr_Field{FIELD_ROW, FIELD_COLUMN, FIELD_BANK, FIELD_CHANNEL, FIELD_RANK, FIELD_GROUP,
+                        NUM_OF_FIELDS}Addr_Field;
+
+static const char *field_names[] = {"row", "column", "bank", "channel", "rank", "group"};
+
+typedef struct Address_Mapping
+{
+    char ordering[64];
+
+    unsigned shift[NUM_OF_FIELDS]; // Lowest bit of each field
+    unsigned bits[NUM_OF_FIELDS]; // Width of each field, the row takes all the bits left
+    bool listed[NUM_OF_FIELDS]; // Whether the ordering has the field
+
+    unsigned interleave; // Channel interleave granularity in bytes
+    unsigned col_low_shift;
+    unsigned col_low_bits;
+
+    bool xor_bank; // Permutation-based interleaving, bank ^= low row bits
+}Address_Mapping;
+
+static Address_Mapping mapping; // The mapping the memory system decodes with
+
+// ordering: fields from MSB to LSB, interleave: bytes, xor_bank: permute the banks.
+bool loadAddressMapping(const char *ordering, unsigned interleave, bool xor_bank)
+{
+    unsigned column_bits = log2(ROW_SIZE / BLOCK_SIZE);
+    if (interleave < BLOCK_SIZE || interleave > ROW_SIZE || (interleave & (interleave - 1)))
+    {
+        printf("Channel interleave must be a power of two between %u and %u bytes\n",
+               BLOCK_SIZE, ROW_SIZE);
+        return false;
+    }
+    mapping.interleave = interleave;
+    mapping.col_low_shift = log2(BLOCK_SIZE);
+    mapping.col_low_bits = log2(interleave / BLOCK_SIZE);
+    mapping.xor_bank = xor_bank;
+
+    mapping.bits[FIELD_ROW] = 0;
+    mapping.bits[FIELD_COLUMN] = column_bits - mapping.col_low_bits;
+    mapping.bits[FIELD_BANK] = log2(NUM_OF_BANKS);
+    mapping.bits[FIELD_CHANNEL] = log2(NUM_OF_CHANNELS);
+    mapping.bits[FIELD_RANK] = 0;
+    mapping.bits[FIELD_GROUP] = 0;
+    for (int i = 0; i < NUM_OF_FIELDS; i++)
+    {
+        mapping.listed[i] = false;
+    }
+
+    // Parse the ordering
+    Addr_Field order[NUM_OF_FIELDS];
+    unsigned num_fields = 0;
+
+    char buf[64];
+    strncpy(buf, ordering, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    strcpy(mapping.ordering, buf);
+
+    char *ptr = strtok(buf, ":");
+    while (ptr != NULL)
+    {
+        int field = -1;
+        for (int i = 0; i < NUM_OF_FIELDS; i++)
+        {
+            if (strcmp(ptr, field_names[i]) == 0)
+            {
+                field = i;
+            }
+        }
+        for (int i = 0; i < num_fields; i++)
+        {
+            if (order[i] == field)
+            {
+                field = -1; // Duplicated
+            }
+        }
+        if (field < 0 || num_fields == NUM_OF_FIELDS)
+        {
+            printf("Invalid address mapping: %s\n", ordering);
+            return false;
+        }
+
+        order[num_fields++] = (Addr_Field)field;
+        mapping.listed[field] = true;
+        ptr = strtok(NULL, ":");
+    }
+
+    if (!mapping.listed[FIELD_ROW] || !mapping.listed[FIELD_COLUMN] ||
+        !mapping.listed[FIELD_BANK] || !mapping.listed[FIELD_CHANNEL] || order[0] != FIELD_ROW)
+    {
+        printf("Address mapping must start with row and list row, column, bank and channel: %s\n",
+               ordering);
+        return false;
+    }
+
+    // A listed rank or bank group takes its bits from the bank field.
+    if (mapping.listed[FIELD_RANK])
+    {
+        mapping.bits[FIELD_RANK] = log2(NUM_OF_RANKS);
+        mapping.bits[FIELD_BANK] -= mapping.bits[FIELD_RANK];
+    }
+    if (mapping.listed[FIELD_GROUP])
+    {
+        mapping.bits[FIELD_GROUP] = log2(NUM_OF_BANK_GROUPS);
+        mapping.bits[FIELD_BANK] -= mapping.bits[FIELD_GROUP];
+    }
+
+    // Lay the fields out from the bottom, above the block offset and the low column bits.
+    unsigned shift = mapping.col_low_shift + mapping.col_low_bits;
+    for (int i = num_fields - 1; i >= 0; i--)
+    {
+        mapping.shift[order[i]] = shift;
+        shift += mapping.bits[order[i]];
+    }
+
+    return true;
+}
+
+uint64_t extractField(uint64_t addr, Addr_Field field)
+{
+    uint64_t value = addr >> mapping.shift[field];
+    if (field == FIELD_ROW)
+    {
+        return value;
+    }
+
+    return value & (((uint64_t)1 << mapping.bits[field]) - 1);
+}
+
+// The bank within the channel, numbered rank by rank and bank group by bank group
+uint64_t extractBank(uint64_t addr)
+{
+    unsigned group_bank_bits = log2(NUM_OF_BANKS / (NUM_OF_RANKS * NUM_OF_BANK_GROUPS));
+    uint64_t bank = extractField(addr, FIELD_BANK);
+    uint64_t rest = bank >> group_bank_bits; // The rank and bank group when not listed
+    bank &= ((uint64_t)1 << group_bank_bits) - 1;
+
+    uint64_t group = rest % NUM_OF_BANK_GROUPS;
+    if (mapping.listed[FIELD_GROUP])
+    {
+        group = extractField(addr, FIELD_GROUP);
+    }
+    else
+    {
+        rest /= NUM_OF_BANK_GROUPS;
+    }
+
+    uint64_t rank = mapping.listed[FIELD_RANK] ? extractField(addr, FIELD_RANK) : rest;
+
+    return ((rank * NUM_OF_BANK_GROUPS + group) << group_bank_bits) | bank;
+}
+
+// Fill in the channel, bank and row of the physical address the request goes to
+void decodePhysicalAddress(Request *req, uint64_t addr)
+{
+    req->channel_id = extractField(addr, FIELD_CHANNEL);
+    req->row_id = extractField(addr, FIELD_ROW);
+    req->bank_id = extractBank(addr);
+
+    if (mapping.xor_bank)
+    {
+        // Rows that conflict in one bank spread over all the banks.
+        req->bank_id ^= req->row_id & (((uint64_t)1 << mapping.bits[FIELD_BANK]) - 1);
+    }
+}
+
+void decodeAddress(Request *req)
+{
+    decodePhysicalAddress(req, req->memory_address);
+}
+
+#endif
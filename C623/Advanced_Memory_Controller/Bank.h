@@ -5,17 +5,230 @@
 #include <inttypes.h> // uint64_t
 
 #include <stdbool.h>
+#include <stdlib.h>
+
+/*
+ * Subarray-level parallelism (Kim et al., ISCA 2012). A bank is split into
+ * NUM_OF_SUBARRAYS subarrays of ROWS_PER_SUBARRAY consecutive rows, each with its own
+ * row buffer and timing state. The bank still takes one request at a time (next_free).
+ *   SALP_NONE: the bank is one subarray, a row conflict waits for PRE and tRP.
+ *   SALP_1: a conflict to another subarray activates it right after the PRE of the
+ *           open one, without waiting for tRP.
+ *   SALP_2: the ACT to the other subarray goes first, the open one is precharged in
+ *           the background once tRAS/tWR allow.
+ *   MASA: every subarray keeps its row open, a row held by any of them is a hit.
+ * Under SALP_1 and SALP_2 at most one subarray of a bank holds an open row.
+ */
+typedef enum Subarray_Policy{SALP_NONE, SALP_1, SALP_2, MASA, NUM_OF_SUBARRAY_POLICIES}Subarray_Policy;
+
+static const char *subarray_policy_names[] = {"none", "salp1", "salp2", "masa"};
+
+static Subarray_Policy subarray_policy = SALP_NONE;
+static unsigned NUM_OF_SUBARRAYS = 8; // subarrays per bank, unused with SALP_NONE
+static unsigned ROWS_PER_SUBARRAY = 512;
+
+/*
+ * Page policy, whether a row stays open once its column command is out.
+ *   OPEN_PAGE: the row stays open until a conflict closes it.
+ *   CLOSED_PAGE: every column command auto-precharges its row.
+ *   ADAPTIVE_PAGE: a saturating counter per bank learns whether the next access to the
+ *                  bank goes to the same row as the last one. The row is precharged right
+ *                  away (auto-precharge) unless the counter predicts a hit.
+ */
+typedef enum Page_Policy{OPEN_PAGE, CLOSED_PAGE, ADAPTIVE_PAGE, NUM_OF_PAGE_POLICIES}Page_Policy;
+
+static const char *page_policy_names[] = {"open", "closed", "adaptive"};
+
+static Page_Policy page_policy = OPEN_PAGE;
+static unsigned PAGE_COUNTER_MAX = 3; // 2-bit counters, rows stay open from half of it up
+
+typedef struct Subarray
+{
+    bool row_open; // whether a row is held in the row buffer
+    uint64_t open_row; // the row held in the row buffer
+    uint64_t open_clk; // the memory clock the ACT of the open row goes out
+
+    // The earliest memory clock each command can be issued to the subarray
+    uint64_t next_act;
+    uint64_t next_pre;
+    uint64_t next_rd;
+    uint64_t next_wr;
+}Subarray;
 
 typedef struct Bank
 {
     uint64_t cur_clk; // current memory clock
     uint64_t next_free; // the future memory clock that the bank is free
+
+    Subarray *subarrays;
+    unsigned num_subarrays; // 1 with SALP_NONE
+    unsigned num_open; // Subarrays holding an open row
+    unsigned active; // The subarray activated last
+
+    /* Page policy */
+    bool accessed; // last_row is valid
+    uint64_t last_row; // The row of the last access, open or not
+    unsigned page_counter; // ADAPTIVE_PAGE, same-row predictor
+    bool closed_early; // The last access precharged its row
+
+    /* Refresh (Controller.h), the last refresh kept the bank from requests in between */
+    uint64_t refresh_begin;
+    uint64_t refresh_end;
+
+    /* Energy (Energy.h), commands sent to the bank */
+    uint64_t num_acts;
+    uint64_t num_pres;
+    uint64_t num_reads;
+    uint64_t num_writes;
+    uint64_t num_refreshes;
+    uint64_t row_open_cycles; // ACT to PRE, summed over the rows closed so far
 }Bank;
 
+void initSubarray(Subarray *subarray)
+{
+    subarray->row_open = false;
+    subarray->open_row = 0;
+    subarray->open_clk = 0;
+
+    subarray->next_act = 0;
+    subarray->next_pre = 0;
+    subarray->next_rd = 0;
+    subarray->next_wr = 0;
+}
+
 void initBank(Bank *bank)
 {
     bank->cur_clk = 0;
     bank->next_free = 0;
+
+    bank->num_subarrays = (subarray_policy == SALP_NONE) ? 1 : NUM_OF_SUBARRAYS;
+    bank->subarrays = (Subarray *)malloc(bank->num_subarrays * sizeof(Subarray));
+    for (unsigned i = 0; i < bank->num_subarrays; i++)
+    {
+        initSubarray(&(bank->subarrays[i]));
+    }
+    bank->num_open = 0;
+    bank->active = 0;
+
+    bank->accessed = false;
+    bank->last_row = 0;
+    bank->page_counter = (PAGE_COUNTER_MAX + 1) / 2; // Weakly open
+    bank->closed_early = false;
+
+    bank->refresh_begin = 0;
+    bank->refresh_end = 0;
+
+    bank->num_acts = 0;
+    bank->num_pres = 0;
+    bank->num_reads = 0;
+    bank->num_writes = 0;
+    bank->num_refreshes = 0;
+    bank->row_open_cycles = 0;
+}
+
+unsigned subarrayIndex(Bank *bank, uint64_t row_id)
+{
+    return (row_id / ROWS_PER_SUBARRAY) % bank->num_subarrays;
+}
+
+// The subarray holding the row
+Subarray *subarrayOf(Bank *bank, uint64_t row_id)
+{
+    return &(bank->subarrays[subarrayIndex(bank, row_id)]);
+}
+
+bool rowHit(Bank *bank, uint64_t row_id)
+{
+    Subarray *subarray = subarrayOf(bank, row_id);
+
+    return subarray->row_open && subarray->open_row == row_id;
+}
+
+// Under SALP_1 and SALP_2, the other subarray whose open row has to be closed before (or
+// while) the subarray is activated, NULL if there is none.
+Subarray *conflictingSubarray(Bank *bank, Subarray *subarray)
+{
+    if (subarray_policy != SALP_1 && subarray_policy != SALP_2)
+    {
+        return NULL;
+    }
+
+    Subarray *active = &(bank->subarrays[bank->active]);
+    return (active != subarray && active->row_open) ? active : NULL;
+}
+
+// The ACT goes out at act_clk
+void openRow(Bank *bank, Subarray *subarray, uint64_t row_id, uint64_t act_clk)
+{
+    if (!subarray->row_open)
+    {
+        ++bank->num_open;
+    }
+    subarray->row_open = true;
+    subarray->open_row = row_id;
+    subarray->open_clk = act_clk;
+    bank->active = subarray - bank->subarrays;
+    ++bank->num_acts;
+}
+
+// The PRE goes out at pre_clk, nothing to do if no row is open
+void closeRow(Bank *bank, Subarray *subarray, uint64_t pre_clk)
+{
+    if (subarray->row_open)
+    {
+        --bank->num_open;
+        bank->row_open_cycles += (pre_clk > subarray->open_clk) ? pre_clk - subarray->open_clk : 0;
+        ++bank->num_pres;
+    }
+    subarray->row_open = false;
+}
+
+// ACT to PRE cycles of the bank up to clk, the rows still open included
+uint64_t rowOpenCycles(Bank *bank, uint64_t clk)
+{
+    uint64_t cycles = bank->row_open_cycles;
+    for (unsigned i = 0; i < bank->num_subarrays; i++)
+    {
+        Subarray *subarray = &(bank->subarrays[i]);
+        if (subarray->row_open && clk > subarray->open_clk)
+        {
+            cycles += clk - subarray->open_clk;
+        }
+    }
+
+    return cycles;
+}
+
+// Train the predictor with the row of a new access. Returns whether the previous access
+// precharged the very row this one wants.
+bool trainPagePredictor(Bank *bank, uint64_t row_id)
+{
+    bool same_row = bank->accessed && bank->last_row == row_id;
+    bool wasted = bank->closed_early && same_row;
+
+    if (bank->accessed && same_row && bank->page_counter < PAGE_COUNTER_MAX)
+    {
+        ++bank->page_counter;
+    }
+    else if (bank->accessed && !same_row && bank->page_counter > 0)
+    {
+        --bank->page_counter;
+    }
+    bank->accessed = true;
+    bank->last_row = row_id;
+
+    return wasted;
+}
+
+// Whether the row of the access that has just been issued stays open
+bool keepRowOpen(Bank *bank)
+{
+    if (page_policy == ADAPTIVE_PAGE)
+    {
+        return 2 * bank->page_counter > PAGE_COUNTER_MAX;
+    }
+
+    return page_policy == OPEN_PAGE;
 }
 
 #endif
@@ -3,30 +3,140 @@
 
 #include "Bank.h"
 #include "Queue.h"
+#include "Heap.h"
+#include "Timing.h"
+#include "Energy.h"
+#include "Histogram.h"
+#include "Timeline.h"
+#include "Sampler.h"
 
 // Bank
 extern void initBank(Bank *bank);
 
 // Queue operations
-extern Queue* initQueue();
-extern void pushToQueue(Queue *q, Request *req);
-extern void migrateToQueue(Queue *q, Node *_node);
+extern Node_Pool* initNodePool(unsigned capacity);
+extern void freeNodePool(Node_Pool *pool);
+extern Node *allocNode(Node_Pool *pool);
+extern void releaseNode(Node_Pool *pool, Node *node);
+extern Queue* initQueue(Node_Pool *pool);
+extern Node *pushToQueue(Queue *q, Request *req);
+extern void removeNode(Queue *q, Node *node);
 extern void deleteNode(Queue *q, Node *node);
+extern void initBankQueue(Bank_Queue *q);
+extern void pushToBankQueue(Bank_Queue *q, Node *node);
+extern void removeFromBankQueue(Bank_Queue *q, Node *node);
+extern Waiting_Queue *initWaitingQueue(Node_Pool *pool, unsigned num_banks);
+extern void freeWaitingQueue(Waiting_Queue *wq);
+extern Node *enqueueRequest(Waiting_Queue *wq, Request *req);
+extern void dequeueRequest(Waiting_Queue *wq, Node *node);
+extern void fillNode(Node *node, Request *req);
+extern Block_Index *initBlockIndex(unsigned num_buckets);
+extern void freeBlockIndex(Block_Index *index);
+extern void insertBlock(Block_Index *index, Node *node, uint64_t block);
+extern void removeBlock(Block_Index *index, Node *node);
+extern Node *findBlock(Block_Index *index, uint64_t block, Request_Type req_type);
+extern void removeBlockReads(Block_Index *index, uint64_t block);
+
+// Heap operations
+extern Heap* initHeap(unsigned capacity);
+extern void freeHeap(Heap *heap);
+extern Node *topOfHeap(Heap *heap);
+extern void pushToHeap(Heap *heap, Node *node);
+extern Node *popFromHeap(Heap *heap);
+
+// Simulation mode
+#define EVENT_DRIVEN // Skip the memory cycles where tick() has nothing to do
+#define COALESCE_READS // Merge reads to a pending block, forward reads from queued writes
+#define TIMELINE // Bank, bus and queue events for --timeline (Timeline.h)
+#define SAMPLER // Bandwidth, queue and bank time series for --samples (Sampler.h)
+
+// Scheduler (Scheduler.h)
+#define FCFS
+//#define FR_FCFS
+//#define PAR_BS
+//#define ATLAS
+//#define BLISS
 
 // CONSTANTS
-static unsigned MAX_WAITING_QUEUE_SIZE = 64;
+static unsigned MAX_WAITING_QUEUE_SIZE = 64; // read queue
+static unsigned MAX_WRITE_QUEUE_SIZE = 64;
+static unsigned WRITE_HIGH_WATERMARK = 48; // start draining writes
+static unsigned WRITE_LOW_WATERMARK = 16; // stop draining writes
+static unsigned MAX_MERGED_READS = 64; // reads riding on another read to the same block
 static unsigned BLOCK_SIZE = 64; // cache block size
 static unsigned NUM_OF_CHANNELS = 4; // 4 channels/controllers in total
 static unsigned NUM_OF_BANKS = 32; // number of banks per channel
+static unsigned NUM_OF_RANKS = 1; // ranks per channel, sharing its data bus
+static unsigned NUM_OF_BANK_GROUPS = 1; // bank groups per rank, 1 for a flat rank
+static unsigned ROW_SIZE = 8192; // bytes held by a bank's row buffer
+static unsigned NUM_OF_CORES = 8; // cores sharing the memory system (trace_gen.py)
+
+/*
+ * Refresh. A channel owes an all-bank refresh every tREFI, or with per-bank refresh a
+ * refresh of the next bank in turn every tREFI / NUM_OF_BANKS. A refresh waits for the
+ * rows of its banks to be precharged, closes them and keeps the banks from taking
+ * requests until tRFC (tRFCpb) is over. Immediate scheduling refreshes as soon as a
+ * refresh is owed. Elastic scheduling postpones it while reads wait for the banks it
+ * would take, until REFRESH_POSTPONE_MAX refreshes are owed (JEDEC allows 8), and
+ * catches up once the reads are gone.
+ */
+typedef enum Refresh_Mode{NO_REFRESH, ALL_BANK_REFRESH, PER_BANK_REFRESH, NUM_OF_REFRESH_MODES}Refresh_Mode;
 
-// DRAM Timings
-static unsigned nclks_channel = 15;
-static unsigned nclks_read = 53;
-static unsigned nclks_write = 53;
+static const char *refresh_mode_names[] = {"none", "all-bank", "per-bank"};
 
-// PCM Timings
-// static unsigned nclks_read = 57;
-// static unsigned nclks_write = 162;
+static Refresh_Mode refresh_mode = NO_REFRESH;
+static bool elastic_refresh = false;
+static unsigned REFRESH_POSTPONE_MAX = 8;
+
+/*
+ * Cycle accounting. Every memory cycle of a channel falls in exactly one class, in this
+ * order of precedence:
+ *   Idle: no request waits to be issued (data may still be in flight).
+ *   Draining: the channel is in a write drain, reads are held back.
+ *   Issuing: a request is issued.
+ *   Queue Full: nothing is issued and a full queue is turning requests away.
+ *   Bank Busy: the oldest request of the queue being served waits for its bank
+ *              (busy, row timing, refresh).
+ *   Channel/Bus: the bank is ready, the oldest request waits for rank, bank-group or
+ *                data bus timing (or the scheduler serves nobody).
+ * The cycles other than idle also go to the bank and core of the request issued, or of
+ * the oldest waiting one. Skipped cycles are counted in bulk, so the stack is the same
+ * with and without EVENT_DRIVEN.
+ */
+typedef enum Cycle_Class{CYCLE_IDLE, CYCLE_DRAINING, CYCLE_ISSUING, CYCLE_QUEUE_FULL,
+                         CYCLE_BANK_BUSY, CYCLE_CHANNEL_BUS, NUM_OF_CYCLE_CLASSES}Cycle_Class;
+
+static const char *cycle_class_names[] = {"Idle", "Draining", "Issuing", "Queue Full", "Bank Busy",
+                                          "Channel/Bus"};
+
+// Timings come from a preset (Timing.h), picked at run time, each channel keeps its own.
+
+/*
+ * Channel hierarchy. The NUM_OF_BANKS banks of a channel are numbered rank by rank and,
+ * within a rank, bank group by bank group. ACTs are tRRD_S apart within a rank and at
+ * most four of them fall in a tFAW window; column commands are tCCD_S apart within a
+ * rank. Within a bank group the longer tRRD_L, tCCD_L and tWTR_L apply, a flat rank
+ * (one bank group) only has the short timings. The ranks share the data bus: a burst
+ * from another rank leaves tRTRS idle clocks on the bus first.
+ */
+typedef struct Bank_Group
+{
+    uint64_t next_act;
+    uint64_t next_rd;
+    uint64_t next_wr;
+}Bank_Group;
+
+typedef struct Rank
+{
+    // The earliest memory clock each command can be issued to the rank
+    uint64_t next_act;
+    uint64_t next_rd;
+    uint64_t next_wr;
+    uint64_t act_history[4]; // The last four ACTs, for the four-activate window
+    unsigned act_history_idx; // The oldest of the last four ACTs
+
+    Bank_Group *groups;
+}Rank;
 
 // Controller definition
 typedef struct Controller
@@ -37,66 +147,1269 @@ typedef struct Controller
     // Current memory clock
     uint64_t cur_clk;
 
-    // Channel status
-    uint64_t channel_next_free;
+    // Timings of the memory part behind this channel
+    Timing *timing;
+    Power power; // Its currents (Energy.h)
+
+    // Rank and bank group status
+    Rank *ranks;
+    int last_col_rank; // Rank and bank group (numbered across the ranks) of the last
+    int last_col_group; // column command, -1 before the first one
+
+    // Every node of the waiting queue and the pending heap comes from this pool.
+    Node_Pool *node_pool;
+
+    // Requests waiting to be issued, reads and writes are kept apart.
+    Waiting_Queue *read_queue;
+    Waiting_Queue *write_queue;
 
-    // A queue contains all the requests that are waiting to be issued.
-    Queue *waiting_queue;
+    // A min-heap contains all the requests that have already been issued
+    // but are waiting to complete, ordered by their completion time.
+    Heap *pending_queue;
 
-    // A queue contains all the requests that have already been issued 
-    // but are waiting to complete.
-    Queue *pending_queue;
+    uint64_t free_mask; // Bit i is set when bank i can accept a new request
+    uint64_t next_seq; // Arrival order of the next request
 
-    /* For decoding */
-    unsigned bank_shift;
-    uint64_t bank_mask;
+    /* Read coalescing and write-to-read forwarding */
+    Block_Index *block_index; // Waiting writes, waiting and in-flight reads
+    unsigned num_merged; // Reads currently riding on another read
+    uint64_t coalesced_reads;
+    uint64_t forwarded_reads;
+
+    /* Write draining */
+    bool draining; // Writes are served in a batch until the low watermark
+    uint64_t drain_begin; // When the current drain started
+    uint64_t drain_episodes;
+    uint64_t drain_cycles;
+    uint64_t writes_issued; // Every write sent to a bank, drained or not
+
+    /* Admission */
+    bool blocked; // A request found its queue full and the channel has not taken one since
+    uint64_t blocked_begin; // When the channel got blocked
+    uint64_t blocked_cycles;
+
+    /* Refresh */
+    uint64_t refreshes_due; // Refreshes that have fallen due so far
+    uint64_t refreshes_done;
+    uint64_t refreshes_postponed; // Refreshes issued after they fell due
+    uint64_t refreshes_forced; // Elastic refreshes issued at the postponement limit
+    uint64_t max_refreshes_owed;
+    uint64_t refresh_cycles; // Bank-cycles kept from requests by refreshes
+    uint64_t refresh_stall_cycles; // Cycles requests waited on a refreshing bank
+    uint64_t refresh_stalled_requests;
+
+    /* Fairness-aware scheduling (Scheduler.h) */
+    unsigned *core_rank; // PAR-BS and ATLAS, rank 0 goes first
+    unsigned num_marked; // PAR-BS, marked requests of the batch not issued yet
+    uint64_t num_batches;
+    uint64_t *core_service; // ATLAS, service each core attained this quantum
+    double *core_total_service; // ATLAS, attained service over the past quanta
+    uint64_t next_quantum;
+    int last_core; // BLISS, core of the last issued request
+    unsigned streak; // BLISS, requests in a row issued for last_core
+    uint64_t blacklist; // BLISS, bit i is set when core i is blacklisted
+    uint64_t next_clearing;
+    uint64_t blacklistings;
+
+    /* Read latency stats, split by whether the read waited through a write drain */
+    uint64_t reads_done[2];
+    uint64_t read_latency[2];
+    Histogram read_latency_hist; // Arrival to completion of every read
+
+    /* Read latency stats of each core */
+    uint64_t *core_reads_done;
+    uint64_t *core_read_latency;
+
+    /* Latency histograms of every request (Histogram.h) */
+    Latency_Histogram channel_latency;
+    Latency_Histogram type_latency[2]; // Indexed by Request_Type
+    Latency_Histogram *bank_latency;
+    Latency_Histogram *core_latency;
+
+    Timeline *timeline; // Event recorder, NULL unless recording
+    Sampler *sampler; // Time series, NULL unless sampling
+
+    /* Row buffer stats */
+    uint64_t row_hits;
+    uint64_t row_misses;
+    uint64_t row_conflicts;
+    uint64_t subarray_overlaps; // ACTs while another subarray of the bank held an open row
+    uint64_t early_precharges; // Rows the page policy closed right after their access
+    uint64_t wasted_precharges; // Early precharges of the row the next access wanted
+
+    /* Cycle accounting */
+    uint64_t cycle_stack[NUM_OF_CYCLE_CLASSES];
+    uint64_t *bank_cycle_stack; // NUM_OF_BANKS x NUM_OF_CYCLE_CLASSES
+    uint64_t *core_cycle_stack; // NUM_OF_CORES x NUM_OF_CYCLE_CLASSES
+
+    /* Column commands, back to back */
+    uint64_t rank_switches; // To another rank than the last one
+    uint64_t same_group_cols; // To the bank group of the last one
+
+    /* Requests received by each bank, to spot hot banks */
+    uint64_t *bank_requests;
 
 }Controller;
 
-Controller *initController()
+// Scheduler interface
+extern void updateScheduler(Controller *controller);
+extern Node *schedule(Controller *controller, Waiting_Queue *wq);
+extern void requestScheduled(Controller *controller, Node *node);
+
+uint64_t maxClk(uint64_t a, uint64_t b)
+{
+    return (a > b) ? a : b;
+}
+
+uint64_t minClk(uint64_t a, uint64_t b)
+{
+    return (a < b) ? a : b;
+}
+
+uint64_t allBanksMask()
+{
+    return (NUM_OF_BANKS == 64) ? UINT64_MAX : (((uint64_t)1 << NUM_OF_BANKS) - 1);
+}
+
+Controller *initController(Timing *channel_timing)
 {
     Controller *controller = (Controller *)malloc(sizeof(Controller));
+    controller->timing = channel_timing;
+    if (!findPowerPreset(channel_timing->name, &(controller->power)))
+    {
+        memset(&(controller->power), 0, sizeof(Power)); // No energy model for the part
+    }
     controller->bank_status = (Bank *)malloc(NUM_OF_BANKS * sizeof(Bank));
     for (int i = 0; i < NUM_OF_BANKS; i++)
     {
         initBank(&((controller->bank_status)[i]));
     }
     controller->cur_clk = 0;
-    controller->channel_next_free = 0;
+    controller->ranks = (Rank *)malloc(NUM_OF_RANKS * sizeof(Rank));
+    for (int i = 0; i < NUM_OF_RANKS; i++)
+    {
+        Rank *rank = &(controller->ranks[i]);
+        rank->next_act = 0;
+        rank->next_rd = 0;
+        rank->next_wr = 0;
+        for (int j = 0; j < 4; j++)
+        {
+            rank->act_history[j] = 0;
+        }
+        rank->act_history_idx = 0;
+
+        rank->groups = (Bank_Group *)malloc(NUM_OF_BANK_GROUPS * sizeof(Bank_Group));
+        for (int j = 0; j < NUM_OF_BANK_GROUPS; j++)
+        {
+            rank->groups[j].next_act = 0;
+            rank->groups[j].next_rd = 0;
+            rank->groups[j].next_wr = 0;
+        }
+    }
+    controller->last_col_rank = -1;
+    controller->last_col_group = -1;
+
+    // Each bank has at most one request waiting for its column command, the column
+    // commands already sent are tCCD apart and stay in flight for up to tCL + tBL.
+    unsigned max_data_latency = maxClk(channel_timing->nclks_cl, channel_timing->nclks_cwl);
+    unsigned max_in_flight = NUM_OF_BANKS + 1 +
+                             (max_data_latency + channel_timing->nclks_bl) / channel_timing->nclks_ccd;
+    controller->node_pool = initNodePool(MAX_WAITING_QUEUE_SIZE + MAX_WRITE_QUEUE_SIZE +
+                                         MAX_MERGED_READS + max_in_flight);
+    controller->pending_queue = initHeap(max_in_flight);
+
+    // The bank masks are 64-bit wide
+    assert(NUM_OF_BANKS <= 64);
+    controller->read_queue = initWaitingQueue(controller->node_pool, NUM_OF_BANKS);
+    controller->write_queue = initWaitingQueue(controller->node_pool, NUM_OF_BANKS);
+    controller->free_mask = allBanksMask();
+    controller->next_seq = 0;
+
+    // At least twice as many buckets as requests the index can hold
+    unsigned num_buckets = 1;
+    while (num_buckets < 2 * (MAX_WAITING_QUEUE_SIZE + MAX_WRITE_QUEUE_SIZE + max_in_flight))
+    {
+        num_buckets *= 2;
+    }
+    controller->block_index = initBlockIndex(num_buckets);
+    controller->num_merged = 0;
+    controller->coalesced_reads = 0;
+    controller->forwarded_reads = 0;
+
+    assert(WRITE_LOW_WATERMARK < WRITE_HIGH_WATERMARK);
+    assert(WRITE_HIGH_WATERMARK <= MAX_WRITE_QUEUE_SIZE);
+    controller->draining = false;
+    controller->drain_begin = 0;
+    controller->drain_episodes = 0;
+    controller->drain_cycles = 0;
+    controller->writes_issued = 0;
+    controller->blocked = false;
+    controller->blocked_begin = 0;
+    controller->blocked_cycles = 0;
+    controller->refreshes_due = 0;
+    controller->refreshes_done = 0;
+    controller->refreshes_postponed = 0;
+    controller->refreshes_forced = 0;
+    controller->max_refreshes_owed = 0;
+    controller->refresh_cycles = 0;
+    controller->refresh_stall_cycles = 0;
+    controller->refresh_stalled_requests = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        controller->reads_done[i] = 0;
+        controller->read_latency[i] = 0;
+    }
+
+    // The core masks are 64-bit wide
+    assert(NUM_OF_CORES <= 64);
+    controller->core_rank = (unsigned *)malloc(NUM_OF_CORES * sizeof(unsigned));
+    controller->core_service = (uint64_t *)malloc(NUM_OF_CORES * sizeof(uint64_t));
+    controller->core_total_service = (double *)malloc(NUM_OF_CORES * sizeof(double));
+    controller->core_reads_done = (uint64_t *)malloc(NUM_OF_CORES * sizeof(uint64_t));
+    controller->core_read_latency = (uint64_t *)malloc(NUM_OF_CORES * sizeof(uint64_t));
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        controller->core_rank[i] = i;
+        controller->core_service[i] = 0;
+        controller->core_total_service[i] = 0;
+        controller->core_reads_done[i] = 0;
+        controller->core_read_latency[i] = 0;
+    }
+    controller->num_marked = 0;
+    controller->num_batches = 0;
+    controller->next_quantum = 0; // Both start at the first tick
+    controller->last_core = -1;
+    controller->streak = 0;
+    controller->blacklist = 0;
+    controller->next_clearing = 0;
+    controller->blacklistings = 0;
+
+    controller->bank_requests = (uint64_t *)malloc(NUM_OF_BANKS * sizeof(uint64_t));
+    for (int i = 0; i < NUM_OF_BANKS; i++)
+    {
+        controller->bank_requests[i] = 0;
+    }
+
+    controller->timeline = NULL;
+    controller->sampler = NULL;
 
-    controller->waiting_queue = initQueue();
-    controller->pending_queue = initQueue();
+    controller->row_hits = 0;
+    controller->row_misses = 0;
+    controller->row_conflicts = 0;
+    controller->subarray_overlaps = 0;
+    controller->early_precharges = 0;
+    controller->wasted_precharges = 0;
+    controller->rank_switches = 0;
+    controller->same_group_cols = 0;
 
-    controller->bank_shift = log2(BLOCK_SIZE) + log2(NUM_OF_CHANNELS);
-    controller->bank_mask = (uint64_t)NUM_OF_BANKS - (uint64_t)1;
+    for (int i = 0; i < NUM_OF_CYCLE_CLASSES; i++)
+    {
+        controller->cycle_stack[i] = 0;
+    }
+    controller->bank_cycle_stack =
+        (uint64_t *)calloc(NUM_OF_BANKS * NUM_OF_CYCLE_CLASSES, sizeof(uint64_t));
+    controller->core_cycle_stack =
+        (uint64_t *)calloc(NUM_OF_CORES * NUM_OF_CYCLE_CLASSES, sizeof(uint64_t));
+
+    initHistogram(&(controller->read_latency_hist));
+    initLatencyHistogram(&(controller->channel_latency));
+    initLatencyHistogram(&(controller->type_latency[READ]));
+    initLatencyHistogram(&(controller->type_latency[WRITE]));
+    controller->bank_latency =
+        (Latency_Histogram *)malloc(NUM_OF_BANKS * sizeof(Latency_Histogram));
+    for (int i = 0; i < NUM_OF_BANKS; i++)
+    {
+        initLatencyHistogram(&(controller->bank_latency[i]));
+    }
+    controller->core_latency =
+        (Latency_Histogram *)malloc(NUM_OF_CORES * sizeof(Latency_Histogram));
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        initLatencyHistogram(&(controller->core_latency[i]));
+    }
 
     return controller;
 }
 
+void freeController(Controller *controller)
+{
+    for (int i = 0; i < NUM_OF_BANKS; i++)
+    {
+        free((controller->bank_status)[i].subarrays);
+    }
+    free(controller->bank_status);
+    for (int i = 0; i < NUM_OF_RANKS; i++)
+    {
+        free(controller->ranks[i].groups);
+    }
+    free(controller->ranks);
+
+    freeWaitingQueue(controller->read_queue);
+    freeWaitingQueue(controller->write_queue);
+    freeHeap(controller->pending_queue);
+    freeBlockIndex(controller->block_index);
+    freeNodePool(controller->node_pool);
+
+    free(controller->core_rank);
+    free(controller->core_service);
+    free(controller->core_total_service);
+    free(controller->core_reads_done);
+    free(controller->core_read_latency);
+    free(controller->bank_requests);
+    free(controller->bank_cycle_stack);
+    free(controller->core_cycle_stack);
+    free(controller->bank_latency);
+    free(controller->core_latency);
+
+    if (controller->timeline != NULL)
+    {
+        freeTimeline(controller->timeline);
+    }
+    if (controller->sampler != NULL)
+    {
+        freeSampler(controller->sampler);
+    }
+    free(controller);
+}
+
 unsigned ongoingPendingRequests(Controller *controller)
 {
-    unsigned num_requests_left = controller->waiting_queue->size + 
+    unsigned num_requests_left = controller->read_queue->queue->size +
+                                 controller->write_queue->queue->size +
                                  controller->pending_queue->size;
 
     return num_requests_left;
 }
 
+// Once the write queue reaches the high watermark, writes are drained in a batch down
+// to the low watermark, so the bus turns around once per batch instead of per write.
+// Called whenever the write queue grows or shrinks.
+void updateDrainState(Controller *controller)
+{
+    unsigned num_writes = controller->write_queue->queue->size;
+
+    if (!controller->draining && num_writes >= WRITE_HIGH_WATERMARK)
+    {
+        controller->draining = true;
+        controller->drain_begin = controller->cur_clk;
+        ++controller->drain_episodes;
+
+        // Every read already waiting now waits through the drain.
+        Node *iter = controller->read_queue->queue->first;
+        while (iter != NULL)
+        {
+            iter->saw_drain = true;
+            iter = iter->next;
+        }
+    }
+    else if (controller->draining && num_writes <= WRITE_LOW_WATERMARK)
+    {
+        controller->draining = false;
+        controller->drain_cycles += controller->cur_clk - controller->drain_begin;
+    }
+}
+
+// The channel is blocked from the first request it turns away for a full queue until
+// it takes a request again. Called on every send(). Page migrations (Hybrid.h) are
+// retried every tick behind the front end's back and are left out.
+void updateBlockedState(Controller *controller, Request *req, bool accepted)
+{
+    if (req->migration)
+    {
+        return;
+    }
+
+    if (!accepted && !controller->blocked)
+    {
+        controller->blocked = true;
+        controller->blocked_begin = controller->cur_clk;
+    }
+    else if (accepted && controller->blocked)
+    {
+        controller->blocked = false;
+        controller->blocked_cycles += controller->cur_clk - controller->blocked_begin;
+    }
+}
+
+// Called whenever a waiting queue grows or shrinks
+void recordQueueDepths(Controller *controller)
+{
+    #ifdef TIMELINE
+    if (controller->timeline != NULL)
+    {
+        recordQueueTimeline(controller->timeline, controller->cur_clk,
+                            controller->read_queue->queue->size,
+                            controller->write_queue->queue->size);
+    }
+    #endif
+}
+
+// Reads go first, writes are only served while draining or when no read is waiting.
+Waiting_Queue *pickQueue(Controller *controller)
+{
+    if (controller->draining || controller->read_queue->queue->size == 0)
+    {
+        return controller->write_queue;
+    }
+
+    return controller->read_queue;
+}
+
+// Latency stats of a request that has its data
+void recordRequestStats(Controller *controller, Node *node)
+{
+    // Page migrations (Hybrid.h) are left out of the latency stats of the cores.
+    if (node->migration)
+    {
+        return;
+    }
+
+    // Arrival, issue and completion of the request
+    uint64_t arrival = node->arrival;
+    uint64_t issue = node->begin_exe;
+    uint64_t completion = node->end_exe;
+    recordLatency(&(controller->channel_latency), arrival, issue, completion);
+    recordLatency(&(controller->type_latency[node->req_type]), arrival, issue, completion);
+    recordLatency(&(controller->bank_latency[node->bank_id]), arrival, issue, completion);
+    recordLatency(&(controller->core_latency[node->core_id]), arrival, issue, completion);
+
+    if (node->req_type == READ)
+    {
+        uint64_t latency = completion - arrival;
+        ++controller->reads_done[node->saw_drain];
+        controller->read_latency[node->saw_drain] += latency;
+        recordValue(&(controller->read_latency_hist), latency);
+        ++controller->core_reads_done[node->core_id];
+        controller->core_read_latency[node->core_id] += latency;
+    }
+}
+
+// A read to a block that already has a queued write gets its data from the write, a
+// read to a block that already has a read waiting or in flight rides on that read. A
+// write to the block takes the reads before it out of the index (send()), so a read
+// never rides on one that returns the data from before the write.
+// Returns whether the read has been taken care of without a new bank access.
+bool coalesceRead(Controller *controller, Request *req)
+{
+    uint64_t block = req->memory_address / BLOCK_SIZE;
+
+    if (findBlock(controller->block_index, block, WRITE) != NULL)
+    {
+        Node forwarded;
+        fillNode(&forwarded, req);
+        forwarded.arrival = controller->cur_clk;
+        forwarded.begin_exe = controller->cur_clk;
+        forwarded.end_exe = controller->cur_clk;
+        forwarded.saw_drain = controller->draining;
+        recordRequestStats(controller, &forwarded);
+
+        ++controller->forwarded_reads;
+        return true;
+    }
+
+    Node *read = findBlock(controller->block_index, block, READ);
+    if (read != NULL && controller->num_merged < MAX_MERGED_READS)
+    {
+        Node *node = allocNode(controller->node_pool);
+        fillNode(node, req);
+        node->arrival = controller->cur_clk;
+        node->saw_drain = controller->draining;
+
+        node->merged = read->merged;
+        read->merged = node;
+        ++controller->num_merged;
+
+        ++controller->coalesced_reads;
+        return true;
+    }
+
+    return false;
+}
+
 bool send(Controller *controller, Request *req)
 {
-    if (controller->waiting_queue->size == MAX_WAITING_QUEUE_SIZE)
+    assert(req->core_id >= 0 && req->core_id < NUM_OF_CORES);
+
+    #ifdef COALESCE_READS
+    // Page migrations (Hybrid.h) move whole pages and are never coalesced.
+    if (req->req_type == READ && !req->migration && coalesceRead(controller, req))
+    {
+        updateBlockedState(controller, req, true);
+        return true;
+    }
+    #endif
+
+    Waiting_Queue *wq = (req->req_type == READ) ? controller->read_queue : controller->write_queue;
+    unsigned max_size = (req->req_type == READ) ? MAX_WAITING_QUEUE_SIZE : MAX_WRITE_QUEUE_SIZE;
+    if (wq->queue->size == max_size)
     {
+        updateBlockedState(controller, req, false);
         return false;
     }
+    updateBlockedState(controller, req, true);
+
+    // The memory system has already decoded the address (Address_Mapping.h).
+    ++controller->bank_requests[req->bank_id];
+
+    // Push to queue, indexed by its target bank
+    Node *node = enqueueRequest(wq, req);
+    node->seq = controller->next_seq++;
+    node->arrival = controller->cur_clk;
+    node->saw_drain = controller->draining;
+    node->marked = false;
+    recordQueueDepths(controller);
+
+    #ifdef COALESCE_READS
+    if (!req->migration)
+    {
+        // Reads already waiting or in flight to the block return the data from before
+        // this write, later reads must not ride on them.
+        uint64_t block = req->memory_address / BLOCK_SIZE;
+        if (req->req_type == WRITE)
+        {
+            removeBlockReads(controller->block_index, block);
+        }
+        insertBlock(controller->block_index, node, block);
+    }
+    #endif
 
-    // Decode the memory address
-    req->bank_id = ((req->memory_address) >> controller->bank_shift) & controller->bank_mask;
-    
-    // Push to queue
-    pushToQueue(controller->waiting_queue, req);
+    if (req->req_type == WRITE)
+    {
+        updateDrainState(controller);
+    }
 
     return true;
 }
 
+// Banks that are free and have at least one waiting request in the queue
+uint64_t readyBanks(Controller *controller, Waiting_Queue *wq)
+{
+    return controller->free_mask & wq->nonempty_mask;
+}
+
+// The oldest request of the queue whose target bank is free, NULL if there is none.
+// Only the head of each ready bank's FIFO needs to be compared.
+Node *oldestReadyRequest(Controller *controller, Waiting_Queue *wq)
+{
+    Node *oldest = NULL;
+
+    uint64_t ready = readyBanks(controller, wq);
+    while (ready)
+    {
+        int bank_id = __builtin_ctzll(ready);
+        ready &= ready - 1;
+
+        Node *head = (wq->bank_queues)[bank_id].first;
+        if (oldest == NULL || head->seq < oldest->seq)
+        {
+            oldest = head;
+        }
+    }
+
+    return oldest;
+}
+
+// Mark the banks whose next_free has passed as free again
+void updateFreeBanks(Controller *controller)
+{
+    uint64_t busy = ~(controller->free_mask) & allBanksMask();
+    while (busy)
+    {
+        int bank_id = __builtin_ctzll(busy);
+        busy &= busy - 1;
+
+        if ((controller->bank_status)[bank_id].next_free <= controller->cur_clk)
+        {
+            controller->free_mask |= (uint64_t)1 << bank_id;
+        }
+    }
+}
+
+// Move an issued request from its waiting queue (and bank FIFO) to the pending heap
+void issueRequest(Controller *controller, Node *node)
+{
+    // No copy, the node itself moves from the waiting queue to the pending heap.
+    Waiting_Queue *wq = (node->req_type == READ) ? controller->read_queue : controller->write_queue;
+    dequeueRequest(wq, node);
+    pushToHeap(controller->pending_queue, node);
+    recordQueueDepths(controller);
+
+    // Reads stay in the block index until their data is back, writes can no longer
+    // forward their data once they are sent to the bank.
+    if (node->req_type == WRITE && node->indexed)
+    {
+        removeBlock(controller->block_index, node);
+    }
+
+    // The target bank is busy until next_free.
+    controller->free_mask &= ~((uint64_t)1 << node->bank_id);
+}
+
+/* Command timing */
+unsigned banksPerRank()
+{
+    return NUM_OF_BANKS / NUM_OF_RANKS;
+}
+
+unsigned banksPerGroup()
+{
+    return NUM_OF_BANKS / (NUM_OF_RANKS * NUM_OF_BANK_GROUPS);
+}
+
+Rank *rankOf(Controller *controller, int bank_id)
+{
+    return &(controller->ranks[bank_id / banksPerRank()]);
+}
+
+Bank_Group *groupOf(Controller *controller, int bank_id)
+{
+    return &(rankOf(controller, bank_id)->groups[(bank_id % banksPerRank()) / banksPerGroup()]);
+}
+
+// The earliest memory clock an ACT can be issued to the subarray of the bank
+uint64_t actReady(Controller *controller, int bank_id, Subarray *subarray)
+{
+    Rank *rank = rankOf(controller, bank_id);
+    uint64_t ready = maxClk(subarray->next_act, rank->next_act);
+    ready = maxClk(ready, groupOf(controller, bank_id)->next_act);
+
+    // At most four ACTs within tFAW
+    uint64_t oldest_act = rank->act_history[rank->act_history_idx];
+    if (oldest_act)
+    {
+        ready = maxClk(ready, oldest_act + controller->timing->nclks_faw);
+    }
+
+    return ready;
+}
+
+// The earliest memory clock a RD/WR can be issued to the subarray of the bank
+uint64_t colReady(Controller *controller, int bank_id, Subarray *subarray, Request_Type req_type)
+{
+    Rank *rank = rankOf(controller, bank_id);
+    Bank_Group *group = groupOf(controller, bank_id);
+    if (req_type == READ)
+    {
+        return maxClk(maxClk(subarray->next_rd, rank->next_rd), group->next_rd);
+    }
+
+    return maxClk(maxClk(subarray->next_wr, rank->next_wr), group->next_wr);
+}
+
+// A column command has gone out at col_clk, data_end: when its data leaves the bus
+void updateColumnTiming(Controller *controller, int bank_id, Request_Type req_type,
+                        uint64_t col_clk, uint64_t data_end)
+{
+    Timing *timing = controller->timing;
+    Rank *rank = rankOf(controller, bank_id);
+    Bank_Group *group = groupOf(controller, bank_id);
+
+    if (req_type == READ)
+    {
+        rank->next_rd = maxClk(rank->next_rd, col_clk + timing->nclks_ccd);
+        rank->next_wr = maxClk(rank->next_wr, col_clk + timing->nclks_rtw);
+        if (NUM_OF_BANK_GROUPS > 1)
+        {
+            group->next_rd = maxClk(group->next_rd, col_clk + timing->nclks_ccd_l);
+        }
+    }
+    else
+    {
+        rank->next_wr = maxClk(rank->next_wr, col_clk + timing->nclks_ccd);
+        rank->next_rd = maxClk(rank->next_rd, data_end + timing->nclks_wtr);
+        if (NUM_OF_BANK_GROUPS > 1)
+        {
+            group->next_wr = maxClk(group->next_wr, col_clk + timing->nclks_ccd_l);
+            group->next_rd = maxClk(group->next_rd, data_end + timing->nclks_wtr_l);
+        }
+    }
+
+    // The bursts of the other ranks come after this one and tRTRS.
+    uint64_t bus_free = data_end + timing->nclks_rtrs;
+    for (int i = 0; i < NUM_OF_RANKS; i++)
+    {
+        Rank *other = &(controller->ranks[i]);
+        if (other == rank)
+        {
+            continue;
+        }
+
+        if (bus_free > timing->nclks_cl)
+        {
+            other->next_rd = maxClk(other->next_rd, bus_free - timing->nclks_cl);
+        }
+        if (bus_free > timing->nclks_cwl)
+        {
+            other->next_wr = maxClk(other->next_wr, bus_free - timing->nclks_cwl);
+        }
+    }
+
+    // Back-to-back stats
+    int rank_id = bank_id / banksPerRank();
+    int group_id = bank_id / banksPerGroup();
+    if (controller->last_col_rank >= 0 && controller->last_col_rank != rank_id)
+    {
+        ++controller->rank_switches;
+    }
+    if (controller->last_col_group == group_id)
+    {
+        ++controller->same_group_cols;
+    }
+    controller->last_col_rank = rank_id;
+    controller->last_col_group = group_id;
+}
+
+// The earliest memory clock the first command of the request (PRE, ACT or RD/WR,
+// depending on the row buffer) can be issued.
+uint64_t earliestIssue(Controller *controller, Node *node)
+{
+    Bank *bank = &((controller->bank_status)[node->bank_id]);
+    Subarray *subarray = subarrayOf(bank, node->row_id);
+
+    if (subarray->row_open && subarray->open_row == node->row_id)
+    {
+        return colReady(controller, node->bank_id, subarray, node->req_type);
+    }
+    else if (subarray->row_open)
+    {
+        return subarray->next_pre;
+    }
+
+    // SALP-1 precharges the other subarray first, SALP-2 may also activate first.
+    Subarray *conflicting = conflictingSubarray(bank, subarray);
+    if (conflicting != NULL && subarray_policy == SALP_1)
+    {
+        return conflicting->next_pre;
+    }
+    else if (conflicting != NULL)
+    {
+        return minClk(conflicting->next_pre, actReady(controller, node->bank_id, subarray));
+    }
+
+    return actReady(controller, node->bank_id, subarray);
+}
+
+bool canIssue(Controller *controller, Node *node)
+{
+    return earliestIssue(controller, node) <= controller->cur_clk;
+}
+
+// Issue the commands of a request starting from the current clock, each command at
+// the earliest memory clock the bank and channel constraints allow.
+void issueCommands(Controller *controller, Node *node)
+{
+    Bank *bank = &((controller->bank_status)[node->bank_id]);
+    Subarray *subarray = subarrayOf(bank, node->row_id);
+    Timing *timing = controller->timing;
+
+    bool row_hit = subarray->row_open && subarray->open_row == node->row_id;
+    Subarray *conflicting = conflictingSubarray(bank, subarray);
+    #ifdef TIMELINE
+    Timeline_Kind row_outcome = row_hit ? TL_ROW_HIT :
+                                ((subarray->row_open || conflicting != NULL) ? TL_ROW_CONFLICT :
+                                                                               TL_ROW_MISS);
+    #endif
+    if (trainPagePredictor(bank, node->row_id))
+    {
+        ++controller->wasted_precharges;
+    }
+
+    if (row_hit)
+    {
+        ++controller->row_hits;
+    }
+    else
+    {
+        if (subarray->row_open)
+        {
+            // Row conflict, close the open row first.
+            uint64_t pre_clk = controller->cur_clk;
+            subarray->next_act = maxClk(subarray->next_act, pre_clk + timing->nclks_rp);
+            closeRow(bank, subarray, pre_clk);
+            ++controller->row_conflicts;
+        }
+        else if (conflicting != NULL)
+        {
+            // Row conflict in another subarray, its precharge overlaps this activation.
+            // SALP-1 has waited for the PRE, SALP-2 sends it once the subarray allows.
+            uint64_t pre_clk = maxClk(controller->cur_clk, conflicting->next_pre);
+            conflicting->next_act = maxClk(conflicting->next_act, pre_clk + timing->nclks_rp);
+            closeRow(bank, conflicting, pre_clk);
+            ++controller->row_conflicts;
+            ++controller->subarray_overlaps;
+        }
+        else
+        {
+            if (bank->num_open)
+            {
+                ++controller->subarray_overlaps; // MASA, the other rows stay open
+            }
+            ++controller->row_misses;
+        }
+
+        uint64_t act_clk = maxClk(controller->cur_clk, actReady(controller, node->bank_id, subarray));
+        subarray->next_pre = act_clk + timing->nclks_ras;
+        subarray->next_act = act_clk + timing->nclks_ras + timing->nclks_rp;
+        subarray->next_rd = act_clk + timing->nclks_rcd;
+        subarray->next_wr = act_clk + timing->nclks_rcd;
+
+        Rank *rank = rankOf(controller, node->bank_id);
+        rank->next_act = act_clk + timing->nclks_rrd;
+        if (NUM_OF_BANK_GROUPS > 1)
+        {
+            groupOf(controller, node->bank_id)->next_act = act_clk + timing->nclks_rrd_l;
+        }
+        rank->act_history[rank->act_history_idx] = act_clk;
+        rank->act_history_idx = (rank->act_history_idx + 1) % 4;
+
+        // The row stays in the row buffer until the page policy or a conflict closes it.
+        openRow(bank, subarray, node->row_id, act_clk);
+    }
+
+    uint64_t col_clk = maxClk(controller->cur_clk,
+                              colReady(controller, node->bank_id, subarray, node->req_type));
+    if (node->req_type == READ)
+    {
+        node->end_exe = col_clk + timing->nclks_cl + timing->nclks_bl;
+        subarray->next_pre = maxClk(subarray->next_pre, col_clk + timing->nclks_rtp);
+    }
+    else
+    {
+        node->end_exe = col_clk + timing->nclks_cwl + timing->nclks_bl;
+        subarray->next_pre = maxClk(subarray->next_pre, node->end_exe + timing->nclks_wr);
+    }
+    updateColumnTiming(controller, node->bank_id, node->req_type, col_clk, node->end_exe);
+    if (node->req_type == READ)
+    {
+        ++bank->num_reads;
+    }
+    else
+    {
+        ++bank->num_writes;
+    }
+    subarray->next_rd = maxClk(subarray->next_rd, col_clk + timing->nclks_ccd);
+    subarray->next_wr = maxClk(subarray->next_wr, col_clk + timing->nclks_ccd);
+
+    // The bank takes a new request once the column command of this one is out.
+    bank->next_free = col_clk + 1;
+
+    // Auto-precharge, as soon as tRAS and tRTP/tWR allow
+    bank->closed_early = !keepRowOpen(bank);
+    if (bank->closed_early)
+    {
+        subarray->next_act = maxClk(subarray->next_act, subarray->next_pre + timing->nclks_rp);
+        closeRow(bank, subarray, subarray->next_pre);
+        ++controller->early_precharges;
+    }
+
+    #ifdef TIMELINE
+    if (controller->timeline != NULL)
+    {
+        recordRequestTimeline(controller->timeline, row_outcome, node->req_type, node->core_id,
+                              node->bank_id, node->row_id, controller->cur_clk, node->end_exe,
+                              timing->nclks_bl);
+    }
+    #endif
+}
+
+/* Refresh */
+bool refreshEnabled(Controller *controller)
+{
+    return refresh_mode != NO_REFRESH && controller->timing->nclks_refi;
+}
+
+// The memory clock the n-th refresh of the channel falls due
+uint64_t refreshDueClk(Controller *controller, uint64_t n)
+{
+    uint64_t slots = (refresh_mode == PER_BANK_REFRESH) ? NUM_OF_BANKS : 1;
+
+    return (n + 1) * controller->timing->nclks_refi / slots;
+}
+
+// The banks the next refresh takes
+uint64_t refreshBanksMask(Controller *controller)
+{
+    if (refresh_mode == PER_BANK_REFRESH)
+    {
+        return (uint64_t)1 << (controller->refreshes_done % NUM_OF_BANKS);
+    }
+
+    return allBanksMask();
+}
+
+// Whether an owed refresh goes out now: always when immediate, when elastic once no read
+// waits for its banks or the postponement limit is reached.
+bool refreshAllowed(Controller *controller)
+{
+    uint64_t owed = controller->refreshes_due - controller->refreshes_done;
+    if (owed == 0)
+    {
+        return false;
+    }
+
+    return !elastic_refresh || owed > REFRESH_POSTPONE_MAX ||
+           !(controller->read_queue->nonempty_mask & refreshBanksMask(controller));
+}
+
+void issueRefresh(Controller *controller)
+{
+    Timing *timing = controller->timing;
+    uint64_t banks = refreshBanksMask(controller);
+    uint64_t owed = controller->refreshes_due - controller->refreshes_done;
+
+    // Every subarray of the banks has to be precharged, and past tRP, first.
+    uint64_t ref_clk = controller->cur_clk;
+    uint64_t mask = banks;
+    while (mask)
+    {
+        Bank *bank = &((controller->bank_status)[__builtin_ctzll(mask)]);
+        mask &= mask - 1;
+
+        for (unsigned i = 0; i < bank->num_subarrays; i++)
+        {
+            Subarray *subarray = &(bank->subarrays[i]);
+            ref_clk = maxClk(ref_clk, subarray->row_open ? subarray->next_pre + timing->nclks_rp :
+                                                           subarray->next_act);
+        }
+    }
+
+    uint64_t end_clk = ref_clk + ((refresh_mode == PER_BANK_REFRESH) ? timing->nclks_rfc_pb :
+                                                                       timing->nclks_rfc);
+    mask = banks;
+    while (mask)
+    {
+        int bank_id = __builtin_ctzll(mask);
+        Bank *bank = &((controller->bank_status)[bank_id]);
+        mask &= mask - 1;
+
+        for (unsigned i = 0; i < bank->num_subarrays; i++)
+        {
+            Subarray *subarray = &(bank->subarrays[i]);
+            closeRow(bank, subarray, maxClk(controller->cur_clk, subarray->next_pre));
+            subarray->next_act = end_clk;
+        }
+        bank->next_free = maxClk(bank->next_free, end_clk);
+        controller->free_mask &= ~((uint64_t)1 << bank_id);
+
+        // The refresh holds the bank from the clock the REF goes out on. A refresh right
+        // behind the previous one (catching up) extends its interval.
+        uint64_t begin_clk = maxClk(ref_clk, bank->refresh_end);
+        if (bank->refresh_end < ref_clk)
+        {
+            bank->refresh_begin = ref_clk;
+        }
+        bank->refresh_end = end_clk;
+        controller->refresh_cycles += end_clk - begin_clk;
+        ++bank->num_refreshes;
+        #ifdef TIMELINE
+        if (controller->timeline != NULL)
+        {
+            recordRefreshTimeline(controller->timeline, bank_id, begin_clk, end_clk);
+        }
+        #endif
+    }
+
+    if (controller->cur_clk > refreshDueClk(controller, controller->refreshes_done))
+    {
+        ++controller->refreshes_postponed;
+    }
+    if (elastic_refresh && owed > REFRESH_POSTPONE_MAX)
+    {
+        ++controller->refreshes_forced;
+    }
+    ++controller->refreshes_done;
+}
+
+// Count the refreshes that have fallen due, issue one if it may go out.
+void updateRefresh(Controller *controller)
+{
+    if (!refreshEnabled(controller))
+    {
+        return;
+    }
+
+    while (refreshDueClk(controller, controller->refreshes_due) <= controller->cur_clk)
+    {
+        ++controller->refreshes_due;
+    }
+    controller->max_refreshes_owed = maxClk(controller->max_refreshes_owed,
+                                            controller->refreshes_due - controller->refreshes_done);
+
+    if (refreshAllowed(controller))
+    {
+        issueRefresh(controller);
+    }
+}
+
+// The part of the wait of a request spent on a refresh of its bank
+void recordRefreshStall(Controller *controller, Node *node)
+{
+    Bank *bank = &((controller->bank_status)[node->bank_id]);
+    uint64_t begin = maxClk(bank->refresh_begin, node->arrival);
+    uint64_t end = minClk(bank->refresh_end, controller->cur_clk);
+
+    if (end > begin)
+    {
+        controller->refresh_stall_cycles += end - begin;
+        ++controller->refresh_stalled_requests;
+    }
+}
+
+/* Energy */
+// pJ the bank has taken so far, by kind (Energy.h)
+void bankEnergy(Controller *controller, int bank_id, double *energy)
+{
+    Bank *bank = &((controller->bank_status)[bank_id]);
+    Power *power = &(controller->power);
+    Timing *timing = controller->timing;
+    unsigned block_bits = BLOCK_SIZE * 8;
+
+    energy[ENERGY_ACT] = bank->num_acts * commandEnergy(power, timing, ENERGY_ACT, block_bits);
+    energy[ENERGY_PRE] = bank->num_pres * commandEnergy(power, timing, ENERGY_PRE, block_bits);
+    energy[ENERGY_RD] = bank->num_reads * commandEnergy(power, timing, ENERGY_RD, block_bits);
+    energy[ENERGY_WR] = bank->num_writes * commandEnergy(power, timing, ENERGY_WR, block_bits);
+
+    // A rank-wide refresh and standby current, split over the banks of the rank. A
+    // per-bank refresh lasts tRFCpb only.
+    unsigned nclks_rfc = (refresh_mode == PER_BANK_REFRESH) ? timing->nclks_rfc_pb : timing->nclks_rfc;
+    energy[ENERGY_REF] = bank->num_refreshes * refreshEnergy(power, nclks_rfc) / banksPerRank();
+    energy[ENERGY_BACKGROUND] = backgroundEnergy(power, controller->cur_clk,
+                                                 rowOpenCycles(bank, controller->cur_clk)) /
+                                banksPerRank();
+}
+
+// pJ the channel has taken so far, by kind
+void channelEnergy(Controller *controller, double *energy)
+{
+    for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+    {
+        energy[k] = 0;
+    }
+
+    double bank_energy[NUM_OF_ENERGY_KINDS];
+    for (int i = 0; i < NUM_OF_BANKS; i++)
+    {
+        bankEnergy(controller, i, bank_energy);
+        for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+        {
+            energy[k] += bank_energy[k];
+        }
+    }
+}
+
+/* Cycle accounting */
+// The earliest memory clock the bank itself lets the first command of the request out,
+// rank, bank group and bus timing aside
+uint64_t bankReady(Controller *controller, Node *node)
+{
+    Bank *bank = &((controller->bank_status)[node->bank_id]);
+    Subarray *subarray = subarrayOf(bank, node->row_id);
+
+    uint64_t ready;
+    if (subarray->row_open && subarray->open_row == node->row_id)
+    {
+        ready = (node->req_type == READ) ? subarray->next_rd : subarray->next_wr;
+    }
+    else if (subarray->row_open)
+    {
+        ready = subarray->next_pre;
+    }
+    else
+    {
+        Subarray *conflicting = conflictingSubarray(bank, subarray);
+        if (conflicting != NULL && subarray_policy == SALP_1)
+        {
+            ready = conflicting->next_pre;
+        }
+        else if (conflicting != NULL)
+        {
+            ready = minClk(conflicting->next_pre, subarray->next_act);
+        }
+        else
+        {
+            ready = subarray->next_act;
+        }
+    }
+
+    return maxClk(bank->next_free, ready);
+}
+
+// Page migrations (Hybrid.h) count for the core whose access triggered them.
+void addCycles(Controller *controller, Cycle_Class cycle_class, Node *node, uint64_t num_cycles)
+{
+    controller->cycle_stack[cycle_class] += num_cycles;
+    if (node != NULL)
+    {
+        controller->bank_cycle_stack[node->bank_id * NUM_OF_CYCLE_CLASSES + cycle_class] += num_cycles;
+        controller->core_cycle_stack[node->core_id * NUM_OF_CYCLE_CLASSES + cycle_class] += num_cycles;
+    }
+}
+
+// Classify the num_cycles memory cycles from first_clk on, issued: the request issued in
+// them (a single cycle), NULL if none. The controller state holds over all of them.
+void accountCycles(Controller *controller, Node *issued, uint64_t first_clk, uint64_t num_cycles)
+{
+    Waiting_Queue *wq = pickQueue(controller);
+    Node *oldest = (issued != NULL) ? issued : wq->queue->first;
+
+    if (oldest == NULL)
+    {
+        addCycles(controller, CYCLE_IDLE, NULL, num_cycles);
+    }
+    else if (controller->draining)
+    {
+        addCycles(controller, CYCLE_DRAINING, oldest, num_cycles);
+    }
+    else if (issued != NULL)
+    {
+        addCycles(controller, CYCLE_ISSUING, issued, num_cycles);
+    }
+    else if (controller->blocked &&
+             (controller->read_queue->queue->size == MAX_WAITING_QUEUE_SIZE ||
+              controller->write_queue->queue->size == MAX_WRITE_QUEUE_SIZE))
+    {
+        addCycles(controller, CYCLE_QUEUE_FULL, oldest, num_cycles);
+    }
+    else
+    {
+        // Waiting on the bank up to bankReady(), on the channel from then on
+        uint64_t bank_ready = bankReady(controller, oldest);
+        uint64_t busy_cycles = (bank_ready > first_clk) ? bank_ready - first_clk : 0;
+        busy_cycles = minClk(busy_cycles, num_cycles);
+        addCycles(controller, CYCLE_BANK_BUSY, oldest, busy_cycles);
+        addCycles(controller, CYCLE_CHANNEL_BUS, oldest, num_cycles - busy_cycles);
+    }
+}
+
+#ifdef SAMPLER
+/* Time series */
+// Queue depths and bank busy cycles of the num_cycles memory cycles from first_clk on, the
+// controller state holds over all of them (Sampler.h)
+void sampleCycles(Controller *controller, uint64_t first_clk, uint64_t num_cycles)
+{
+    Sampler *sampler = controller->sampler;
+    sampler->cur.read_occupancy += controller->read_queue->queue->size * num_cycles;
+    sampler->cur.write_occupancy += controller->write_queue->queue->size * num_cycles;
+
+    uint64_t end_clk = first_clk + num_cycles;
+    for (int i = 0; i < NUM_OF_BANKS; i++)
+    {
+        uint64_t next_free = (controller->bank_status)[i].next_free;
+        if (next_free > first_clk)
+        {
+            sampler->cur_busy[i] += minClk(next_free, end_clk) - first_clk;
+        }
+    }
+}
+#endif
+
+// The earliest memory clock at which tick() can change the controller state: the
+// first pending request finishes or the first waiting request can be issued.
+uint64_t nextEvent(Controller *controller)
+{
+    uint64_t next_clk = UINT64_MAX;
+
+    if (controller->pending_queue->size)
+    {
+        next_clk = topOfHeap(controller->pending_queue)->end_exe;
+    }
+
+    Waiting_Queue *wq = pickQueue(controller);
+    if (wq->queue->size)
+    {
+        #ifdef FCFS
+        Node *first = wq->queue->first;
+        uint64_t issue_clk = maxClk((controller->bank_status)[first->bank_id].next_free,
+                                    earliestIssue(controller, first));
+        #else
+        // The other schedulers may pick any bank with waiting requests once it is free.
+        uint64_t issue_clk = UINT64_MAX;
+        uint64_t nonempty = wq->nonempty_mask;
+        while (nonempty)
+        {
+            int bank_id = __builtin_ctzll(nonempty);
+            nonempty &= nonempty - 1;
+
+            // Whichever request is picked, its first command is a PRE, an ACT or
+            // a RD/WR to one of the subarrays, so the earliest of them is a safe
+            // lower bound.
+            Bank *bank = &((controller->bank_status)[bank_id]);
+            uint64_t cmd_clk = UINT64_MAX;
+            for (unsigned i = 0; i < bank->num_subarrays; i++)
+            {
+                Subarray *subarray = &(bank->subarrays[i]);
+                cmd_clk = minClk(cmd_clk, minClk(subarray->next_pre,
+                                                 actReady(controller, bank_id, subarray)));
+                cmd_clk = minClk(cmd_clk, colReady(controller, bank_id, subarray, READ));
+                cmd_clk = minClk(cmd_clk, colReady(controller, bank_id, subarray, WRITE));
+            }
+
+            uint64_t bank_issue_clk = maxClk(bank->next_free, cmd_clk);
+            if (bank_issue_clk < issue_clk)
+            {
+                issue_clk = bank_issue_clk;
+            }
+        }
+        #endif
+
+        if (issue_clk < next_clk)
+        {
+            next_clk = issue_clk;
+        }
+    }
+
+    // The next refresh falls due, or an owed one may go out right away.
+    if (refreshEnabled(controller))
+    {
+        uint64_t refresh_clk = refreshAllowed(controller) ?
+                               controller->cur_clk + 1 :
+                               refreshDueClk(controller, controller->refreshes_due);
+        next_clk = minClk(next_clk, refresh_clk);
+    }
+
+    #ifdef SAMPLER
+    // The current epoch ends, a sample is taken. An idle channel is ticked anyway.
+    if (controller->sampler != NULL && next_clk != UINT64_MAX)
+    {
+        next_clk = minClk(next_clk, (controller->cur_clk / SAMPLE_EPOCH + 1) * SAMPLE_EPOCH);
+    }
+    #endif
+
+    if (next_clk == UINT64_MAX || next_clk <= controller->cur_clk)
+    {
+        next_clk = controller->cur_clk + 1;
+    }
+
+    return next_clk;
+}
+
+// Advance the controller clock so that the next tick() lands exactly on target_clk.
+// Returns the number of memory cycles that have been skipped.
+uint64_t fastForward(Controller *controller, uint64_t target_clk)
+{
+    if (target_clk <= controller->cur_clk + 1)
+    {
+        return 0;
+    }
+
+    uint64_t skipped = target_clk - 1 - controller->cur_clk;
+    accountCycles(controller, NULL, controller->cur_clk + 1, skipped);
+    #ifdef SAMPLER
+    if (controller->sampler != NULL)
+    {
+        sampleCycles(controller, controller->cur_clk + 1, skipped);
+    }
+    #endif
+
+    controller->cur_clk += skipped;
+    for (int i = 0; i < NUM_OF_BANKS; i++)
+    {
+        (controller->bank_status)[i].cur_clk += skipped;
+    }
+
+    return skipped;
+}
+
 void tick(Controller *controller)
 {
     // Step one, update system stats
@@ -108,53 +1421,95 @@ void tick(Controller *controller)
         // printf("%"PRIu64"\n", (controller->bank_status)[i].cur_clk);
     }
     // printf("\n");
+    updateFreeBanks(controller);
+    updateScheduler(controller);
 
-    // Step two, serve pending requests
-    if (controller->pending_queue->size)
+    // Step two, serve pending requests, all the requests finished by now retire in this cycle
+    while (controller->pending_queue->size &&
+           topOfHeap(controller->pending_queue)->end_exe <= controller->cur_clk)
     {
-        Node *first = controller->pending_queue->first;
-        if (first->end_exe <= controller->cur_clk)
+        Node *first = popFromHeap(controller->pending_queue);
+        /*
+        printf("Clk: ""%"PRIu64"\n", controller->cur_clk);
+        printf("Address: ""%"PRIu64"\n", first->mem_addr);
+        printf("Channel ID: %d\n", first->channel_id);
+        printf("Bank ID: %d\n", first->bank_id);
+        printf("Begin execution: ""%"PRIu64"\n", first->begin_exe);
+        printf("End execution: ""%"PRIu64"\n\n", first->end_exe);
+        */
+
+        recordRequestStats(controller, first);
+        #ifdef SAMPLER
+        if (controller->sampler != NULL)
+        {
+            sampleTransfer(controller->sampler, first->req_type);
+        }
+        #endif
+        if (first->indexed)
         {
-            /*
-            printf("Clk: ""%"PRIu64"\n", controller->cur_clk);
-            printf("Address: ""%"PRIu64"\n", first->mem_addr);
-            printf("Channel ID: %d\n", first->channel_id);
-            printf("Bank ID: %d\n", first->bank_id);
-            printf("Begin execution: ""%"PRIu64"\n", first->begin_exe);
-            printf("End execution: ""%"PRIu64"\n\n", first->end_exe);
-            */
+            removeBlock(controller->block_index, first);
+        }
+
+        // The reads coalesced into this one get their data now as well.
+        Node *merged = first->merged;
+        while (merged != NULL)
+        {
+            Node *next = merged->merged;
+
+            merged->begin_exe = merged->arrival;
+            merged->end_exe = first->end_exe;
+            recordRequestStats(controller, merged);
 
-            deleteNode(controller->pending_queue, first);
+            releaseNode(controller->node_pool, merged);
+            --controller->num_merged;
+            merged = next;
         }
+
+        releaseNode(controller->node_pool, first);
     }
 
-    // Step three, find a request to schedule
-    if (controller->waiting_queue->size)
-    {
-        // Implementation One - FCFS
-        Node *first = controller->waiting_queue->first;
-        int target_bank_id = first->bank_id;
+    // Step three, refresh the banks when a refresh is owed and may go out
+    updateRefresh(controller);
 
-        if ((controller->bank_status)[target_bank_id].next_free <= controller->cur_clk && 
-            controller->channel_next_free <= controller->cur_clk)
+    // Step four, find a request to schedule
+    Waiting_Queue *wq = pickQueue(controller);
+    Node *target = NULL;
+    if (wq->queue->size)
+    {
+        target = schedule(controller, wq);
+        if (target != NULL)
         {
-            first->begin_exe = controller->cur_clk;
-            if (first->req_type == READ)
-            {
-                first->end_exe = first->begin_exe + (uint64_t)nclks_read;
-            }
-            else if (first->req_type == WRITE)
+            target->begin_exe = controller->cur_clk;
+            recordRefreshStall(controller, target);
+            issueCommands(controller, target);
+            requestScheduled(controller, target);
+
+            issueRequest(controller, target);
+            accountCycles(controller, target, controller->cur_clk, 1);
+
+            if (target->req_type == WRITE)
             {
-                first->end_exe = first->begin_exe + (uint64_t)nclks_write;
+                ++controller->writes_issued;
+                updateDrainState(controller);
             }
-            // The target bank is no longer free until this request completes.
-            (controller->bank_status)[target_bank_id].next_free = first->end_exe;
-            controller->channel_next_free = controller->cur_clk + nclks_channel;
+        }
+    }
 
-            migrateToQueue(controller->pending_queue, first);
-            deleteNode(controller->waiting_queue, first);
+    if (target == NULL)
+    {
+        accountCycles(controller, NULL, controller->cur_clk, 1);
+    }
+
+    #ifdef SAMPLER
+    if (controller->sampler != NULL)
+    {
+        sampleCycles(controller, controller->cur_clk, 1);
+        if (controller->cur_clk % SAMPLE_EPOCH == 0)
+        {
+            closeSample(controller->sampler, controller->cur_clk);
         }
     }
+    #endif
 }
 
 #endif
@@ -0,0 +1,198 @@
+#ifndef __CORE_HH__
+#define __CORE_HH__
+
+#include "Trace.h"
+#include "Mem_System.h"
+
+extern bool getRequest(TraceParser *mem_trace);
+
+/*
+ * Closed-loop core model. Every core replays its own requests of the trace (the ones
+ * with its core_id, or its own trace of a mix) in order, one per cycle at most. Writes
+ * are posted, but a core can have at most MSHR_LIMIT reads in flight: with a full MSHR
+ * it stalls until one of its reads returns. Memory latency thus slows the cores down,
+ * and each core gets its own execution time.
+ */
+static unsigned MSHR_LIMIT = 16; // outstanding reads per core (ROB/MSHR limit)
+
+typedef struct Core
+{
+    TraceParser *trace; // Requests of this core only, NULL once exhausted
+
+    bool has_req; // trace->cur_req is waiting to enter the memory system
+
+    uint64_t requests_issued;
+    uint64_t reads_issued;
+
+    bool finished; // Trace exhausted and every read returned
+    uint64_t finish_clk;
+}Core;
+
+typedef struct Core_Model
+{
+    Core *cores;
+}Core_Model;
+
+// openTrace: the requests of one core, only_core: replay a single core's requests, -1 for
+// every core
+Core_Model *initCoreModel(TraceParser *(*openTrace)(int core_id), int only_core)
+{
+    Core_Model *model = (Core_Model *)malloc(sizeof(Core_Model));
+    model->cores = (Core *)malloc(NUM_OF_CORES * sizeof(Core));
+
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        Core *core = &(model->cores[i]);
+
+        core->trace = NULL;
+        if (only_core < 0 || only_core == i)
+        {
+            core->trace = openTrace(i);
+        }
+        core->has_req = false;
+        core->requests_issued = 0;
+        core->reads_issued = 0;
+        core->finished = false;
+        core->finish_clk = 0;
+    }
+
+    return model;
+}
+
+// The traces of the cores are closed as they run out
+void freeCoreModel(Core_Model *model)
+{
+    free(model->cores);
+    free(model);
+}
+
+unsigned outstandingReads(MemorySystem *mem_system, int core_id, Core *core)
+{
+    return core->reads_issued - coreReadsDone(mem_system, core_id);
+}
+
+// A core is finished once its trace is exhausted and all its reads have returned.
+void checkFinished(MemorySystem *mem_system, Core_Model *model)
+{
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        Core *core = &(model->cores[i]);
+        if (!core->finished && core->trace == NULL && !core->has_req &&
+            outstandingReads(mem_system, i, core) == 0)
+        {
+            core->finished = true;
+            core->finish_clk = mem_system->controllers[0]->cur_clk;
+        }
+    }
+}
+
+bool allFinished(Core_Model *model)
+{
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        if (!model->cores[i].finished)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Run the cores until all of them are finished, returns the execution time.
+uint64_t runClosedLoop(MemorySystem *mem_system, Core_Model *model)
+{
+    uint64_t cycles = 0;
+
+    checkFinished(mem_system, model);
+    while (!allFinished(model) || pendingRequests(mem_system))
+    {
+        // The core that goes first rotates every cycle, so no core always wins the
+        // last free queue entry.
+        #ifdef EVENT_DRIVEN
+        bool accepted = false;
+        #endif
+        unsigned first_core = mem_system->controllers[0]->cur_clk % NUM_OF_CORES;
+        for (int j = 0; j < NUM_OF_CORES; j++)
+        {
+            int i = (first_core + j) % NUM_OF_CORES;
+            Core *core = &(model->cores[i]);
+
+            if (!core->has_req && core->trace != NULL)
+            {
+                core->has_req = getRequest(core->trace);
+                if (!core->has_req)
+                {
+                    core->trace = NULL; // getRequest() has released the parser
+                }
+            }
+
+            if (!core->has_req)
+            {
+                continue;
+            }
+
+            Request *req = core->trace->cur_req;
+            if (req->req_type == READ && outstandingReads(mem_system, i, core) >= MSHR_LIMIT)
+            {
+                continue; // MSHR full, wait for a read to return
+            }
+
+            if (access(mem_system, req))
+            {
+                core->has_req = false;
+                ++core->requests_issued;
+                if (req->req_type == READ)
+                {
+                    ++core->reads_issued;
+                }
+                #ifdef EVENT_DRIVEN
+                accepted = true;
+                #endif
+            }
+        }
+        checkFinished(mem_system, model);
+
+        #ifdef EVENT_DRIVEN
+        // Every core is stalled (full MSHR or full queue) or done, nothing changes
+        // until the memory system does.
+        if (!accepted)
+        {
+            cycles += fastForwardEvent(mem_system, nextSystemEvent(mem_system));
+        }
+        #endif
+
+        tickEvent(mem_system);
+        ++cycles;
+
+        checkFinished(mem_system, model);
+    }
+
+    return cycles;
+}
+
+// Memory requests the core completes per cycle, for lack of instruction counts
+double coreIPC(Core_Model *model, int core_id)
+{
+    Core *core = &(model->cores[core_id]);
+
+    return core->finish_clk ? (double)core->requests_issued / core->finish_clk : 0.0;
+}
+
+void printCoreStats(Core_Model *model)
+{
+    printf("MSHR Limit: %u\n", MSHR_LIMIT);
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        Core *core = &(model->cores[i]);
+        if (core->requests_issued == 0)
+        {
+            continue;
+        }
+
+        printf("Core %d: Requests ""%"PRIu64" | Finish Time ""%"PRIu64" | IPC Proxy %f\n",
+               i, core->requests_issued, core->finish_clk, coreIPC(model, i));
+    }
+}
+
+#endif
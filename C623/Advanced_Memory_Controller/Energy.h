@@ -0,0 +1,123 @@
+#ifndef __ENERGY_HH__
+#define __ENERGY_HH__
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h> // uint64_t
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Timing.h"
+
+/*
+ * IDD-based energy model (as in the Micron power calculator and DRAMPower). Every
+ * command costs the current drawn above the standby current over its duration:
+ *   ACT: (IDD0 - IDD3N) over tRAS      PRE: (IDD0 - IDD2N) over tRP
+ *   RD: (IDD4R - IDD3N) over the burst  WR: (IDD4W - IDD3N) over the burst
+ *   REF: (IDD5B - IDD3N) over tRFC, or tRFCpb for a per-bank refresh, for a whole rank
+ * and the background is IDD2N (precharge standby) all along, plus IDD3N - IDD2N while
+ * rows are open. A bank takes 1/banks of the rank for the standby current and an
+ * all-bank refresh, and for the active standby increment while its own rows are open.
+ *
+ * A resistive part (PCM) adds the energy of its cell array: reading a block out of it
+ * and, far more, programming the written block. DRAM parts leave both at zero.
+ *
+ * Powers are matched to the timing presets (Timing.h) by name. Currents are per device,
+ * in mA, and mA x V x ns = pJ.
+ */
+typedef enum Energy_Kind{ENERGY_ACT, ENERGY_PRE, ENERGY_RD, ENERGY_WR, ENERGY_REF,
+                         ENERGY_BACKGROUND, NUM_OF_ENERGY_KINDS}Energy_Kind;
+
+static const char *energy_kind_names[] = {"ACT", "PRE", "RD", "WR", "REF", "Background"};
+
+typedef struct Power
+{
+    const char *name; // The timing preset it goes with
+
+    double vdd; // V
+    double tck; // ns per memory clock
+    unsigned devices; // Devices per rank that make up the channel width
+
+    double idd0; // ACT-PRE cycling
+    double idd2n; // Precharge standby
+    double idd3n; // Active standby
+    double idd4r; // Read burst
+    double idd4w; // Write burst
+    double idd5b; // Refresh burst
+
+    double array_read; // pJ per bit read out of the cell array
+    double array_write; // pJ per bit programmed into the cell array
+}Power;
+
+static Power power_presets[] =
+{
+    // name,        vdd,  tck,   devices, idd0, idd2n, idd3n, idd4r, idd4w, idd5b,
+    //              array_read, array_write
+    // DDR4 8Gb x8, a 64-bit rank of 8 devices
+    {"DDR4-2400",   1.2,  0.833, 8,       58,   36,    46,    150,   140,   250,
+                    0,          0},
+    // DDR5 16Gb x8, a 32-bit subchannel of 4 devices
+    {"DDR5-4800",   1.1,  0.416, 4,       75,   55,    70,    265,   240,   290,
+                    0,          0},
+    // PCM with DDR4-like peripherals, array energies of Lee et al. (ISCA 2009)
+    {"PCM",         1.2,  0.833, 8,       58,   36,    46,    150,   140,   0,
+                    2.47,       16.82},
+};
+
+bool findPowerPreset(const char *name, Power *dst)
+{
+    unsigned num_presets = sizeof(power_presets) / sizeof(Power);
+    for (unsigned i = 0; i < num_presets; i++)
+    {
+        if (strcmp(power_presets[i].name, name) == 0)
+        {
+            *dst = power_presets[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// pJ of a refresh of the rank that lasts nclks_rfc
+double refreshEnergy(Power *power, unsigned nclks_rfc)
+{
+    double scale = power->vdd * power->tck * power->devices;
+
+    return (power->idd5b > power->idd3n) ? (power->idd5b - power->idd3n) * nclks_rfc * scale : 0.0;
+}
+
+// pJ of one command of the rank, block_bits: the bits of a data burst. REF is all-bank.
+double commandEnergy(Power *power, Timing *timing, Energy_Kind kind, unsigned block_bits)
+{
+    double scale = power->vdd * power->tck * power->devices;
+
+    switch (kind)
+    {
+        case ENERGY_ACT:
+            return (power->idd0 - power->idd3n) * timing->nclks_ras * scale;
+        case ENERGY_PRE:
+            return (power->idd0 - power->idd2n) * timing->nclks_rp * scale;
+        case ENERGY_RD:
+            return (power->idd4r - power->idd3n) * timing->nclks_bl * scale +
+                   power->array_read * block_bits;
+        case ENERGY_WR:
+            return (power->idd4w - power->idd3n) * timing->nclks_bl * scale +
+                   power->array_write * block_bits;
+        case ENERGY_REF:
+            return refreshEnergy(power, timing->nclks_rfc);
+        default:
+            return 0.0;
+    }
+}
+
+// pJ of the rank background, cycles in total and open_cycles of them with a row open
+double backgroundEnergy(Power *power, uint64_t cycles, uint64_t open_cycles)
+{
+    double scale = power->vdd * power->tck * power->devices;
+
+    return (power->idd2n * cycles + (power->idd3n - power->idd2n) * open_cycles) * scale;
+}
+
+#endif
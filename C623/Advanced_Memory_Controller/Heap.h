@@ -0,0 +1,96 @@
+#ifndef __HEAP_HH__
+#define __HEAP_HH__
+
+#include "Queue.h"
+
+// A binary min-heap of issued requests, keyed on their completion time (end_exe).
+typedef struct Heap
+{
+    Node **nodes;
+
+    unsigned size; // Current size of the heap
+    unsigned capacity; // Number of slots allocated for nodes
+}Heap;
+
+Heap* initHeap(unsigned capacity)
+{
+    Heap *heap = (Heap *)malloc(sizeof(Heap));
+
+    heap->nodes = (Node **)malloc(capacity * sizeof(Node *));
+    heap->size = 0;
+    heap->capacity = capacity;
+
+    return heap;
+}
+
+void freeHeap(Heap *heap)
+{
+    free(heap->nodes);
+    free(heap);
+}
+
+// The request that completes the earliest
+Node *topOfHeap(Heap *heap)
+{
+    assert(heap->size > 0);
+
+    return heap->nodes[0];
+}
+
+void pushToHeap(Heap *heap, Node *node)
+{
+    if (heap->size == heap->capacity)
+    {
+        heap->capacity = 2 * heap->capacity;
+        heap->nodes = (Node **)realloc(heap->nodes, heap->capacity * sizeof(Node *));
+    }
+
+    // Sift up
+    unsigned i = heap->size;
+    while (i > 0)
+    {
+        unsigned parent = (i - 1) / 2;
+        if (heap->nodes[parent]->end_exe <= node->end_exe)
+        {
+            break;
+        }
+        heap->nodes[i] = heap->nodes[parent];
+        i = parent;
+    }
+    heap->nodes[i] = node;
+    heap->size = heap->size + 1;
+}
+
+Node *popFromHeap(Heap *heap)
+{
+    assert(heap->size > 0);
+
+    Node *top = heap->nodes[0];
+
+    heap->size = heap->size - 1;
+    Node *last = heap->nodes[heap->size];
+
+    // Sift down
+    unsigned i = 0;
+    while (2 * i + 1 < heap->size)
+    {
+        unsigned child = 2 * i + 1;
+        if (child + 1 < heap->size &&
+            heap->nodes[child + 1]->end_exe < heap->nodes[child]->end_exe)
+        {
+            child = child + 1;
+        }
+
+        if (last->end_exe <= heap->nodes[child]->end_exe)
+        {
+            break;
+        }
+        heap->nodes[i] = heap->nodes[child];
+        i = child;
+    }
+    heap->nodes[i] = last;
+
+    return top;
+}
+
+#endif
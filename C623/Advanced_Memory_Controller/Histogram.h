@@ -0,0 +1,192 @@
+#ifndef __HISTOGRAM_HH__
+#define __HISTOGRAM_HH__
+
+#include <stdio.h>
+
+#include <math.h>
+
+#include "Request.h"
+
+/*
+ * Log-bucketed latency histogram (HDR-style) of fixed size. Values below 2^SUB_BITS
+ * get a bucket each, above that every power of two is split into 2^(SUB_BITS - 1)
+ * buckets, so a percentile is off by at most 1/16 of its value. Values are clamped to
+ * 2^HIST_MAX_BITS - 1 memory clocks.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_MAX_BITS 32
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_HALF_BUCKETS (HIST_SUB_BUCKETS / 2)
+#define HIST_BUCKETS (HIST_SUB_BUCKETS + (HIST_MAX_BITS - HIST_SUB_BITS) * HIST_HALF_BUCKETS)
+
+typedef struct Histogram
+{
+    uint64_t counts[HIST_BUCKETS];
+
+    uint64_t total; // Number of values recorded
+    uint64_t sum;
+    uint64_t max;
+}Histogram;
+
+void initHistogram(Histogram *hist)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        hist->counts[i] = 0;
+    }
+    hist->total = 0;
+    hist->sum = 0;
+    hist->max = 0;
+}
+
+unsigned bucketOf(uint64_t value)
+{
+    if (value >= ((uint64_t)1 << HIST_MAX_BITS))
+    {
+        value = ((uint64_t)1 << HIST_MAX_BITS) - 1;
+    }
+
+    if (value < HIST_SUB_BUCKETS)
+    {
+        return value;
+    }
+
+    // Keep the top HIST_SUB_BITS bits of the value, the top one is always set.
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned shift = msb - (HIST_SUB_BITS - 1);
+
+    return HIST_SUB_BUCKETS + (shift - 1) * HIST_HALF_BUCKETS +
+           (value >> shift) - HIST_HALF_BUCKETS;
+}
+
+// The largest value that falls into the bucket
+uint64_t bucketTop(unsigned bucket)
+{
+    if (bucket < HIST_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    unsigned shift = (bucket - HIST_SUB_BUCKETS) / HIST_HALF_BUCKETS + 1;
+    uint64_t top_bits = (bucket - HIST_SUB_BUCKETS) % HIST_HALF_BUCKETS + HIST_HALF_BUCKETS;
+
+    return ((top_bits + 1) << shift) - 1;
+}
+
+void recordValue(Histogram *hist, uint64_t value)
+{
+    ++hist->counts[bucketOf(value)];
+    ++hist->total;
+    hist->sum += value;
+    if (value > hist->max)
+    {
+        hist->max = value;
+    }
+}
+
+void mergeHistogram(Histogram *dst, Histogram *src)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->max > dst->max)
+    {
+        dst->max = src->max;
+    }
+}
+
+// The value below which the given fraction of the recorded values fall
+uint64_t valueAtPercentile(Histogram *hist, double percentile)
+{
+    if (hist->total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)ceil(percentile / 100 * hist->total);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t top = bucketTop(i);
+            return (top < hist->max) ? top : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+double meanValue(Histogram *hist)
+{
+    return hist->total ? (double)hist->sum / hist->total : 0.0;
+}
+
+// Queueing delay (arrival to issue) and service time (issue to completion)
+typedef struct Latency_Histogram
+{
+    Histogram queueing;
+    Histogram service;
+}Latency_Histogram;
+
+void initLatencyHistogram(Latency_Histogram *lat)
+{
+    initHistogram(&(lat->queueing));
+    initHistogram(&(lat->service));
+}
+
+void recordLatency(Latency_Histogram *lat, uint64_t arrival, uint64_t issue, uint64_t completion)
+{
+    recordValue(&(lat->queueing), issue - arrival);
+    recordValue(&(lat->service), completion - issue);
+}
+
+void mergeLatencyHistogram(Latency_Histogram *dst, Latency_Histogram *src)
+{
+    mergeHistogram(&(dst->queueing), &(src->queueing));
+    mergeHistogram(&(dst->service), &(src->service));
+}
+
+void printPercentiles(Histogram *hist)
+{
+    printf("p50 %"PRIu64" | p95 %"PRIu64" | p99 %"PRIu64" | p99.9 %"PRIu64,
+           valueAtPercentile(hist, 50), valueAtPercentile(hist, 95),
+           valueAtPercentile(hist, 99), valueAtPercentile(hist, 99.9));
+}
+
+void printLatencyHistogram(const char *label, Latency_Histogram *lat)
+{
+    printf("%s: Requests %"PRIu64"\n", label, lat->queueing.total);
+    printf("    Queueing Delay: ");
+    printPercentiles(&(lat->queueing));
+    printf(" | Mean %f\n", meanValue(&(lat->queueing)));
+    printf("    Service Time: ");
+    printPercentiles(&(lat->service));
+    printf(" | Mean %f\n", meanValue(&(lat->service)));
+}
+
+// group,id,metric,count,mean,p50,p95,p99,p99.9,max
+void writeLatencyCSV(FILE *fd, const char *group, int id, Latency_Histogram *lat)
+{
+    Histogram *hists[2] = {&(lat->queueing), &(lat->service)};
+    const char *metrics[2] = {"queueing", "service"};
+    for (int i = 0; i < 2; i++)
+    {
+        Histogram *hist = hists[i];
+        fprintf(fd, "%s,%d,%s,%"PRIu64",%f,%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64"\n",
+                group, id, metrics[i], hist->total, meanValue(hist),
+                valueAtPercentile(hist, 50), valueAtPercentile(hist, 95),
+                valueAtPercentile(hist, 99), valueAtPercentile(hist, 99.9), hist->max);
+    }
+}
+
+#endif
@@ -0,0 +1,372 @@
+#ifndef __HYBRID_HH__
+#define __HYBRID_HH__
+
+#include "Controller.h"
+#include "Address_Mapping.h"
+
+extern bool send(Controller *controller, Request *req);
+
+/*
+ * Hybrid DRAM + PCM memory system. The first NUM_OF_CHANNELS - NUM_OF_PCM_CHANNELS
+ * channels are DRAM, the rest PCM. Every page starts in PCM, at its own address. A page
+ * that gets HOT_THRESHOLD accesses while in PCM is migrated to a free DRAM frame; when
+ * DRAM is full, a victim is picked with the clock algorithm and written back to PCM.
+ * Access counters are halved every DECAY_INTERVAL accesses so that only recently hot
+ * pages move.
+ *
+ * The page table is switched as soon as a migration starts, the copy itself (a read of
+ * every block from the source tier and a write to the destination tier) is injected
+ * into the channels as regular requests, so migration costs bandwidth and bank time.
+ */
+static unsigned NUM_OF_PCM_CHANNELS = 0; // 0 for an all-DRAM memory system
+static unsigned PAGE_SIZE = 4096; // migration granularity in bytes
+static unsigned DRAM_PAGES = 4096; // DRAM capacity in pages
+static unsigned HOT_THRESHOLD = 8; // PCM accesses before a page is migrated, 0 never migrates
+static unsigned DECAY_INTERVAL = 100000; // accesses between halving the access counters
+
+typedef struct Page_Entry
+{
+    uint64_t page; // Page number + 1, 0 when the slot is empty
+    uint64_t frame; // DRAM frame holding the page, when in_dram
+    bool in_dram;
+    unsigned count; // Accesses while in PCM
+}Page_Entry;
+
+// Block transfers of the migrations, waiting for room in one channel's queues
+typedef struct Migration_Queue
+{
+    Request *reqs; // Circular buffer
+    unsigned head;
+    unsigned size;
+    unsigned capacity;
+}Migration_Queue;
+
+typedef struct Tier_Manager
+{
+    unsigned num_dram_channels;
+    unsigned num_pcm_channels;
+
+    // Page table, open addressing with linear probing
+    Page_Entry *pages;
+    uint64_t num_slots; // Power of two
+    uint64_t num_pages;
+
+    // DRAM frames
+    uint64_t *frame_page; // Page held by each frame
+    bool *referenced; // Clock bits
+    uint64_t frames_used;
+    uint64_t clock_hand;
+
+    uint64_t accesses_since_decay;
+
+    Migration_Queue *migration_queues; // One per channel
+
+    /* Stats */
+    uint64_t dram_accesses;
+    uint64_t pcm_accesses;
+    uint64_t migrations;
+    uint64_t evictions;
+    uint64_t migration_requests; // Block transfers injected into the channels
+}Tier_Manager;
+
+Tier_Manager *initTierManager()
+{
+    Tier_Manager *tiers = (Tier_Manager *)malloc(sizeof(Tier_Manager));
+
+    assert(NUM_OF_PCM_CHANNELS > 0 && NUM_OF_PCM_CHANNELS < NUM_OF_CHANNELS);
+    assert(PAGE_SIZE % BLOCK_SIZE == 0);
+    tiers->num_dram_channels = NUM_OF_CHANNELS - NUM_OF_PCM_CHANNELS;
+    tiers->num_pcm_channels = NUM_OF_PCM_CHANNELS;
+
+    tiers->num_slots = 1024;
+    tiers->num_pages = 0;
+    tiers->pages = (Page_Entry *)calloc(tiers->num_slots, sizeof(Page_Entry));
+
+    tiers->frame_page = (uint64_t *)malloc(DRAM_PAGES * sizeof(uint64_t));
+    tiers->referenced = (bool *)calloc(DRAM_PAGES, sizeof(bool));
+    tiers->frames_used = 0;
+    tiers->clock_hand = 0;
+
+    tiers->accesses_since_decay = 0;
+
+    tiers->migration_queues = (Migration_Queue *)malloc(NUM_OF_CHANNELS * sizeof(Migration_Queue));
+    for (int i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        tiers->migration_queues[i].capacity = 2 * PAGE_SIZE / BLOCK_SIZE;
+        tiers->migration_queues[i].reqs =
+            (Request *)malloc(tiers->migration_queues[i].capacity * sizeof(Request));
+        tiers->migration_queues[i].head = 0;
+        tiers->migration_queues[i].size = 0;
+    }
+
+    tiers->dram_accesses = 0;
+    tiers->pcm_accesses = 0;
+    tiers->migrations = 0;
+    tiers->evictions = 0;
+    tiers->migration_requests = 0;
+
+    return tiers;
+}
+
+void freeTierManager(Tier_Manager *tiers)
+{
+    free(tiers->pages);
+    free(tiers->frame_page);
+    free(tiers->referenced);
+    for (int i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        free(tiers->migration_queues[i].reqs);
+    }
+    free(tiers->migration_queues);
+    free(tiers);
+}
+
+/* Page table */
+Page_Entry *findPage(Tier_Manager *tiers, uint64_t page)
+{
+    uint64_t slot = (page * 0x9E3779B97F4A7C15ULL) & (tiers->num_slots - 1);
+    while (tiers->pages[slot].page != 0 && tiers->pages[slot].page != page + 1)
+    {
+        slot = (slot + 1) & (tiers->num_slots - 1);
+    }
+
+    return &(tiers->pages[slot]);
+}
+
+// The entry of the page, a new page starts in PCM
+Page_Entry *lookupPage(Tier_Manager *tiers, uint64_t page)
+{
+    Page_Entry *entry = findPage(tiers, page);
+    if (entry->page != 0)
+    {
+        return entry;
+    }
+
+    // Keep the table at most half full
+    if (2 * (tiers->num_pages + 1) > tiers->num_slots)
+    {
+        Page_Entry *old_pages = tiers->pages;
+        uint64_t old_slots = tiers->num_slots;
+
+        tiers->num_slots *= 2;
+        tiers->pages = (Page_Entry *)calloc(tiers->num_slots, sizeof(Page_Entry));
+        for (uint64_t i = 0; i < old_slots; i++)
+        {
+            if (old_pages[i].page != 0)
+            {
+                *findPage(tiers, old_pages[i].page - 1) = old_pages[i];
+            }
+        }
+        free(old_pages);
+
+        entry = findPage(tiers, page);
+    }
+
+    entry->page = page + 1;
+    entry->frame = 0;
+    entry->in_dram = false;
+    entry->count = 0;
+    ++tiers->num_pages;
+
+    return entry;
+}
+
+// Decode a physical address of a tier. The tier's channels take turns every interleave
+// bytes, whatever their number, and the bank, row and column come from what is left of
+// the address once that channel digit is taken out, laid out as the mapping lays out a
+// channel-0 address.
+void decodeTierAddress(Tier_Manager *tiers, Request *req, uint64_t addr, bool in_dram)
+{
+    unsigned num_channels = in_dram ? tiers->num_dram_channels : tiers->num_pcm_channels;
+    uint64_t unit = addr / mapping.interleave;
+    uint64_t local = (unit / num_channels) * mapping.interleave + addr % mapping.interleave;
+
+    // Open a zero channel field where the mapping has it
+    unsigned shift = mapping.shift[FIELD_CHANNEL];
+    uint64_t low = local & (((uint64_t)1 << shift) - 1);
+    decodePhysicalAddress(req, ((local >> shift) << (shift + mapping.bits[FIELD_CHANNEL])) | low);
+
+    req->channel_id = unit % num_channels;
+    if (!in_dram)
+    {
+        req->channel_id += tiers->num_dram_channels;
+    }
+}
+
+// Where the request goes right now, nothing is counted so a stalled request can retry.
+void translateAddress(Tier_Manager *tiers, Request *req)
+{
+    uint64_t page = req->memory_address / PAGE_SIZE;
+    Page_Entry *entry = lookupPage(tiers, page);
+
+    if (entry->in_dram)
+    {
+        uint64_t offset = req->memory_address % PAGE_SIZE;
+        decodeTierAddress(tiers, req, entry->frame * PAGE_SIZE + offset, true);
+    }
+    else
+    {
+        decodeTierAddress(tiers, req, req->memory_address, false);
+    }
+}
+
+/* Migration engine */
+void pushMigrationRequest(Tier_Manager *tiers, Request *req)
+{
+    Migration_Queue *mq = &(tiers->migration_queues[req->channel_id]);
+    if (mq->size == mq->capacity)
+    {
+        // Unroll the circular buffer into a buffer twice as large
+        Request *reqs = (Request *)malloc(2 * mq->capacity * sizeof(Request));
+        for (unsigned i = 0; i < mq->size; i++)
+        {
+            reqs[i] = mq->reqs[(mq->head + i) % mq->capacity];
+        }
+        free(mq->reqs);
+        mq->reqs = reqs;
+        mq->head = 0;
+        mq->capacity *= 2;
+    }
+
+    mq->reqs[(mq->head + mq->size) % mq->capacity] = *req;
+    ++mq->size;
+    ++tiers->migration_requests;
+}
+
+// Read every block of the page from one tier and write it to the other
+void copyPage(Tier_Manager *tiers, int core_id, uint64_t src_addr, bool src_dram,
+              uint64_t dst_addr, bool dst_dram)
+{
+    Request req;
+    req.core_id = core_id;
+    req.migration = true;
+    for (uint64_t offset = 0; offset < PAGE_SIZE; offset += BLOCK_SIZE)
+    {
+        req.req_type = READ;
+        req.memory_address = src_addr + offset;
+        decodeTierAddress(tiers, &req, src_addr + offset, src_dram);
+        pushMigrationRequest(tiers, &req);
+
+        req.req_type = WRITE;
+        req.memory_address = dst_addr + offset;
+        decodeTierAddress(tiers, &req, dst_addr + offset, dst_dram);
+        pushMigrationRequest(tiers, &req);
+    }
+}
+
+// Move a PCM page to DRAM, making room with the clock algorithm when DRAM is full
+void migratePage(Tier_Manager *tiers, Page_Entry *entry, int core_id)
+{
+    uint64_t frame;
+    if (tiers->frames_used < DRAM_PAGES)
+    {
+        frame = tiers->frames_used++;
+    }
+    else
+    {
+        while (tiers->referenced[tiers->clock_hand])
+        {
+            tiers->referenced[tiers->clock_hand] = false;
+            tiers->clock_hand = (tiers->clock_hand + 1) % DRAM_PAGES;
+        }
+        frame = tiers->clock_hand;
+        tiers->clock_hand = (tiers->clock_hand + 1) % DRAM_PAGES;
+
+        // Write the victim back to its home in PCM
+        uint64_t victim = tiers->frame_page[frame];
+        Page_Entry *victim_entry = findPage(tiers, victim);
+        victim_entry->in_dram = false;
+        victim_entry->count = 0;
+        copyPage(tiers, core_id, frame * PAGE_SIZE, true, victim * PAGE_SIZE, false);
+        ++tiers->evictions;
+    }
+
+    uint64_t page = entry->page - 1;
+    entry->in_dram = true;
+    entry->frame = frame;
+    tiers->frame_page[frame] = page;
+    tiers->referenced[frame] = true;
+    copyPage(tiers, core_id, page * PAGE_SIZE, false, frame * PAGE_SIZE, true);
+    ++tiers->migrations;
+}
+
+// Count an access the memory system has accepted, hot PCM pages are migrated.
+void recordPageAccess(Tier_Manager *tiers, Request *req)
+{
+    Page_Entry *entry = lookupPage(tiers, req->memory_address / PAGE_SIZE);
+
+    if (entry->in_dram)
+    {
+        ++tiers->dram_accesses;
+        tiers->referenced[entry->frame] = true;
+    }
+    else
+    {
+        ++tiers->pcm_accesses;
+        if (HOT_THRESHOLD && ++entry->count >= HOT_THRESHOLD)
+        {
+            migratePage(tiers, entry, req->core_id);
+        }
+    }
+
+    if (++tiers->accesses_since_decay == DECAY_INTERVAL)
+    {
+        for (uint64_t i = 0; i < tiers->num_slots; i++)
+        {
+            tiers->pages[i].count /= 2;
+        }
+        tiers->accesses_since_decay = 0;
+    }
+}
+
+// Hand the waiting block transfers to their channels, as many as the queues take
+void injectMigrations(Tier_Manager *tiers, Controller **controllers)
+{
+    for (int i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Migration_Queue *mq = &(tiers->migration_queues[i]);
+        while (mq->size && send(controllers[i], &(mq->reqs[mq->head])))
+        {
+            mq->head = (mq->head + 1) % mq->capacity;
+            --mq->size;
+        }
+    }
+}
+
+unsigned pendingMigrations(Tier_Manager *tiers)
+{
+    unsigned num_migrations = 0;
+    for (int i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        num_migrations += tiers->migration_queues[i].size;
+    }
+
+    return num_migrations;
+}
+
+// Whether some block transfer can enter its channel right now
+bool migrationReady(Tier_Manager *tiers, Controller **controllers)
+{
+    for (int i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Migration_Queue *mq = &(tiers->migration_queues[i]);
+        if (mq->size == 0)
+        {
+            continue;
+        }
+
+        Request *req = &(mq->reqs[mq->head]);
+        unsigned size = (req->req_type == READ) ? controllers[i]->read_queue->queue->size :
+                                                  controllers[i]->write_queue->queue->size;
+        unsigned max_size = (req->req_type == READ) ? MAX_WAITING_QUEUE_SIZE :
+                                                      MAX_WRITE_QUEUE_SIZE;
+        if (size < max_size)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef __LOAD_GENERATOR_HH__
+#define __LOAD_GENERATOR_HH__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <math.h>
+
+#include "Mem_System.h"
+
+extern bool access(MemorySystem *mem_system, Request *req);
+extern unsigned pendingRequests(MemorySystem *mem_system);
+extern void tickEvent(MemorySystem *mem_system);
+extern uint64_t nextSystemEvent(MemorySystem *mem_system);
+extern uint64_t fastForwardEvent(MemorySystem *mem_system, uint64_t target_clk);
+
+/*
+ * Open-loop synthetic load. Requests arrive at a target rate (requests per memory clock,
+ * over the whole memory system) whatever the memory does: an arrival that finds its
+ * queue full waits at the source, in arrival order, and the wait is counted as source
+ * delay. Sweeping the rate gives the latency-vs-offered-load curve of a configuration.
+ *
+ * Arrivals are Poisson, or bursty: batches arrive as a Poisson process and a batch
+ * holds a geometric number of requests (mean LOAD_BURST) that arrive together, so the
+ * mean rate is the same. The cores take turns; each one walks its own stream, going to
+ * the next block with probability LOAD_LOCALITY and to a random block of the footprint
+ * otherwise. A fixed seed makes every run, and every point of a sweep, repeatable.
+ */
+typedef enum Arrival_Process{ARRIVAL_POISSON, ARRIVAL_BURSTY, NUM_OF_ARRIVAL_PROCESSES}Arrival_Process;
+
+static const char *arrival_process_names[] = {"poisson", "bursty"};
+
+static Arrival_Process arrival_process = ARRIVAL_POISSON;
+static double LOAD_READ_RATIO = 0.67; // fraction of the requests that are reads
+static double LOAD_LOCALITY = 0.5; // probability of going on to the next block
+static double LOAD_BURST = 8; // mean requests per batch, bursty arrivals only
+static uint64_t LOAD_FOOTPRINT = (uint64_t)1 << 30; // bytes the random blocks come from
+static uint64_t LOAD_REQUESTS = 100000; // requests per run
+static uint64_t LOAD_SEED = 1;
+
+typedef struct Load_Generator
+{
+    double rate; // Offered load, requests per memory clock
+    uint64_t rng; // xorshift64* state
+
+    double batch_arrival; // When the current batch arrives, in memory clocks
+    uint64_t batch_left; // Requests of the current batch not generated yet
+    uint64_t *stream; // The last block of each core
+
+    uint64_t generated;
+    bool has_req; // req has arrived, or will, and waits to enter the memory system
+    Request req;
+    uint64_t arrival_clk; // The memory clock req arrives at
+
+    /* Stats */
+    Histogram source_delay; // Arrival to acceptance, every request
+    Histogram read_source_delay;
+}Load_Generator;
+
+// One point of the latency-vs-offered-load curve
+typedef struct Load_Point
+{
+    double offered; // Requests per memory clock
+    double achieved;
+    uint64_t cycles;
+    double read_latency; // Mean, acceptance to data
+    uint64_t read_p50;
+    uint64_t read_p99;
+    double source_delay; // Mean, every request
+    uint64_t source_p99;
+    double total_read_latency; // Mean, arrival to data
+}Load_Point;
+
+Load_Generator *initLoadGenerator(double rate)
+{
+    Load_Generator *gen = (Load_Generator *)malloc(sizeof(Load_Generator));
+
+    gen->rate = rate;
+    gen->rng = LOAD_SEED ? LOAD_SEED : 1; // xorshift never leaves 0
+
+    gen->batch_arrival = 0;
+    gen->batch_left = 0;
+    gen->stream = (uint64_t *)malloc(NUM_OF_CORES * sizeof(uint64_t));
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        gen->stream[i] = 0;
+    }
+
+    gen->generated = 0;
+    gen->has_req = false;
+    gen->arrival_clk = 0;
+
+    initHistogram(&(gen->source_delay));
+    initHistogram(&(gen->read_source_delay));
+
+    return gen;
+}
+
+void freeLoadGenerator(Load_Generator *gen)
+{
+    free(gen->stream);
+    free(gen);
+}
+
+/* Random numbers */
+uint64_t nextRandom(Load_Generator *gen)
+{
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+
+    return gen->rng * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [0, 1)
+double uniformRandom(Load_Generator *gen)
+{
+    return (nextRandom(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Exponential with the given rate
+double exponentialRandom(Load_Generator *gen, double rate)
+{
+    return -log(1 - uniformRandom(gen)) / rate;
+}
+
+// Geometric on 1, 2, ... with the given mean
+uint64_t geometricRandom(Load_Generator *gen, double mean)
+{
+    if (mean <= 1)
+    {
+        return 1;
+    }
+
+    return 1 + (uint64_t)floor(log(1 - uniformRandom(gen)) / log(1 - 1 / mean));
+}
+
+// Generate the next request and its arrival
+void nextLoadRequest(Load_Generator *gen)
+{
+    if (gen->batch_left == 0)
+    {
+        double burst = (arrival_process == ARRIVAL_BURSTY) ? LOAD_BURST : 1;
+        gen->batch_arrival += exponentialRandom(gen, gen->rate / burst);
+        gen->batch_left = (arrival_process == ARRIVAL_BURSTY) ? geometricRandom(gen, burst) : 1;
+    }
+    --gen->batch_left;
+
+    int core_id = gen->generated % NUM_OF_CORES;
+    uint64_t num_blocks = LOAD_FOOTPRINT / BLOCK_SIZE;
+    uint64_t block;
+    if (uniformRandom(gen) < LOAD_LOCALITY)
+    {
+        block = (gen->stream[core_id] + 1) % num_blocks;
+    }
+    else
+    {
+        block = nextRandom(gen) % num_blocks;
+    }
+    gen->stream[core_id] = block;
+
+    gen->req.core_id = core_id;
+    gen->req.req_type = (uniformRandom(gen) < LOAD_READ_RATIO) ? READ : WRITE;
+    gen->req.memory_address = block * BLOCK_SIZE;
+    gen->req.migration = false;
+
+    gen->arrival_clk = (uint64_t)ceil(gen->batch_arrival);
+    gen->has_req = true;
+    ++gen->generated;
+}
+
+// Run the generator until its requests are all done, returns the execution time.
+uint64_t runLoad(MemorySystem *mem_system, Load_Generator *gen)
+{
+    uint64_t cycles = 0;
+
+    while (gen->generated < LOAD_REQUESTS || gen->has_req || pendingRequests(mem_system))
+    {
+        // Everything that has arrived by now enters, in arrival order, until a queue is full.
+        uint64_t cur_clk = mem_system->controllers[0]->cur_clk;
+        while (true)
+        {
+            if (!gen->has_req && gen->generated < LOAD_REQUESTS)
+            {
+                nextLoadRequest(gen);
+            }
+
+            if (!gen->has_req || gen->arrival_clk > cur_clk || !access(mem_system, &(gen->req)))
+            {
+                break;
+            }
+
+            gen->has_req = false;
+            recordValue(&(gen->source_delay), cur_clk - gen->arrival_clk);
+            if (gen->req.req_type == READ)
+            {
+                recordValue(&(gen->read_source_delay), cur_clk - gen->arrival_clk);
+            }
+        }
+
+        #ifdef EVENT_DRIVEN
+        // Nothing can enter before the next arrival or before a channel makes room.
+        uint64_t next_clk = nextSystemEvent(mem_system);
+        if (gen->has_req && gen->arrival_clk > cur_clk && gen->arrival_clk < next_clk)
+        {
+            next_clk = gen->arrival_clk;
+        }
+        cycles += fastForwardEvent(mem_system, next_clk);
+        #endif
+
+        tickEvent(mem_system);
+        ++cycles;
+    }
+
+    return cycles;
+}
+
+// The curve point of a finished run
+void measureLoad(MemorySystem *mem_system, Load_Generator *gen, uint64_t cycles, Load_Point *point)
+{
+    Histogram *read_latency = (Histogram *)malloc(sizeof(Histogram));
+    initHistogram(read_latency);
+    for (int i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        mergeHistogram(read_latency, &(mem_system->controllers[i]->read_latency_hist));
+    }
+
+    point->offered = gen->rate;
+    point->achieved = cycles ? (double)gen->generated / cycles : 0.0;
+    point->cycles = cycles;
+    point->read_latency = meanValue(read_latency);
+    point->read_p50 = valueAtPercentile(read_latency, 50);
+    point->read_p99 = valueAtPercentile(read_latency, 99);
+    point->source_delay = meanValue(&(gen->source_delay));
+    point->source_p99 = valueAtPercentile(&(gen->source_delay), 99);
+    point->total_read_latency = point->read_latency + meanValue(&(gen->read_source_delay));
+
+    free(read_latency);
+}
+
+void printLoadConfig()
+{
+    printf("Load Generator: %s | Reads %.0f%% | Locality %f | Footprint %"PRIu64" B | "
+           "Requests %"PRIu64" | Seed %"PRIu64"",
+           arrival_process_names[arrival_process], 100 * LOAD_READ_RATIO, LOAD_LOCALITY,
+           LOAD_FOOTPRINT, LOAD_REQUESTS, LOAD_SEED);
+    if (arrival_process == ARRIVAL_BURSTY)
+    {
+        printf(" | Mean Burst %f", LOAD_BURST);
+    }
+    printf("\n");
+    printf("Peak Load: %f requests/clock\n", (double)NUM_OF_CHANNELS / timing.nclks_ccd);
+}
+
+void printLoadPoint(Load_Point *point)
+{
+    printf("Offered Load %f | Achieved Load %f | Read Latency: Mean %f | p50 %"PRIu64" | "
+           "p99 %"PRIu64" | Source Delay: Mean %f | p99 %"PRIu64" | Total Read Latency %f\n",
+           point->offered, point->achieved, point->read_latency, point->read_p50,
+           point->read_p99, point->source_delay, point->source_p99, point->total_read_latency);
+}
+
+// The curve as CSV, one row per offered load
+bool writeLoadCurve(Load_Point *points, unsigned num_points, const char *path)
+{
+    FILE *fd = fopen(path, "w");
+    if (fd == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fd, "offered,achieved,cycles,read_mean,read_p50,read_p99,source_mean,source_p99,"
+            "total_read_mean\n");
+    for (unsigned i = 0; i < num_points; i++)
+    {
+        Load_Point *point = &(points[i]);
+        fprintf(fd, "%f,%f,%"PRIu64",%f,%"PRIu64",%"PRIu64",%f,%"PRIu64",%f\n",
+                point->offered, point->achieved, point->cycles, point->read_latency,
+                point->read_p50, point->read_p99, point->source_delay, point->source_p99,
+                point->total_read_latency);
+    }
+    fclose(fd);
+
+    return true;
+}
+
+#endif
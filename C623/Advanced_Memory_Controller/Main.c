@@ -1,36 +1,93 @@
 #include "Trace.h"
 
 #include "Mem_System.h"
+#include "Parallel.h"
+#include "Core.h"
+#include "Load_Generator.h"
 
 extern TraceParser *initTraceParser(const char * mem_file);
+extern TraceParser *initTraceMix(const char **mem_files, unsigned num_files, Mix_Policy policy,
+                                 const unsigned *weights);
 extern bool getRequest(TraceParser *mem_trace);
+extern void closeTraceParser(TraceParser *mem_trace);
 
 extern MemorySystem *initMemorySystem();
+extern void freeMemorySystem(MemorySystem *mem_system);
 extern unsigned pendingRequests(MemorySystem *mem_system);
 extern bool access(MemorySystem *mem_system, Request *req);
+extern bool admit(MemorySystem *mem_system, Request *req);
+extern bool drainAdmissionBuffers(MemorySystem *mem_system);
 extern void tickEvent(MemorySystem *mem_system);
+extern uint64_t nextSystemEvent(MemorySystem *mem_system);
+extern uint64_t fastForwardEvent(MemorySystem *mem_system, uint64_t target_clk);
+extern void printMemorySystemStats(MemorySystem *mem_system);
+extern uint64_t coreReadsDone(MemorySystem *mem_system, int core_id);
+extern double coreReadLatency(MemorySystem *mem_system, int core_id);
+extern bool writeLatencyReport(MemorySystem *mem_system, const char *path);
+extern bool writeCycleReport(MemorySystem *mem_system, const char *path);
+extern void printEnergySummary(MemorySystem *mem_system);
+extern void enableSampler(MemorySystem *mem_system);
+extern bool writeSamples(MemorySystem *mem_system, const char *path);
+extern void enableTimeline(MemorySystem *mem_system);
+extern bool writeTimeline(MemorySystem *mem_system, const char *path);
 
-int main(int argc, const char *argv[])
-{	
-    if (argc != 2)
-    {
-        printf("Usage: %s %s\n", argv[0], "<mem-file>");
+extern uint64_t runParallel(MemorySystem *mem_system, TraceParser *mem_trace);
 
-        return 0;
-    }
+extern Core_Model *initCoreModel(TraceParser *(*openTrace)(int core_id), int only_core);
+extern void freeCoreModel(Core_Model *model);
+extern uint64_t runClosedLoop(MemorySystem *mem_system, Core_Model *model);
+extern double coreIPC(Core_Model *model, int core_id);
+extern void printCoreStats(Core_Model *model);
 
-    // Initialize a CPU trace parser
-    TraceParser *mem_trace = initTraceParser(argv[1]);
+extern Load_Generator *initLoadGenerator(double rate);
+extern void freeLoadGenerator(Load_Generator *gen);
+extern uint64_t runLoad(MemorySystem *mem_system, Load_Generator *gen);
+extern void measureLoad(MemorySystem *mem_system, Load_Generator *gen, uint64_t cycles, Load_Point *point);
+extern void printLoadConfig();
+extern void printLoadPoint(Load_Point *point);
+extern bool writeLoadCurve(Load_Point *points, unsigned num_points, const char *path);
 
-    // Initialize the memory system
-    MemorySystem *mem_system = initMemorySystem();
-    // printf("%u\n", controller->bank_shift);
-    // printf("%u\n", controller->bank_mask);
+extern bool loadTimingPreset(const char *name);
+extern bool findTimingPreset(const char *name, Timing *dst);
+extern bool loadAddressMapping(const char *ordering, unsigned interleave, bool xor_bank);
+extern void printTimingPresets();
+
+// The workload: one trace file, or single-program traces mixed on the fly (Trace.h)
+static const char *mix_files[64];
+static unsigned num_mix_files = 0; // 0 when replaying a single trace file
+static Mix_Policy mix_policy = MIX_ROUND_ROBIN;
+static unsigned mix_weights[64];
+static const char *mix_policy_names[] = {"rr", "timestamp", "rate"};
+
+// The requests of the workload, core_id: only this core's, -1 for every core
+TraceParser *openTrace(int core_id)
+{
+    TraceParser *mem_trace;
+    if (num_mix_files)
+    {
+        mem_trace = initTraceMix(mix_files, num_mix_files, mix_policy, mix_weights);
+    }
+    else
+    {
+        mem_trace = initTraceParser(mix_files[0]);
+    }
+    mem_trace->core_filter = core_id;
+
+    return mem_trace;
+}
 
+// Replay the trace through the memory system, returns the execution time.
+uint64_t replay(MemorySystem *mem_system, TraceParser *mem_trace, bool parallel)
+{
     uint64_t cycles = 0;
 
     bool stall = false;
-    bool end = false;
+    bool end = parallel; // The channel threads replay the trace themselves
+
+    if (parallel)
+    {
+        cycles = runParallel(mem_system, mem_trace);
+    }
 
     while (!end || pendingRequests(mem_system))
     {
@@ -41,23 +98,776 @@ int main(int argc, const char *argv[])
 
         if (!end)
         {
-            stall = !(access(mem_system, mem_trace->cur_req));
+            if (mem_system->admission != NULL)
+            {
+                stall = !(admit(mem_system, mem_trace->cur_req));
+            }
+            else
+            {
+                stall = !(access(mem_system, mem_trace->cur_req));
+            }
 	    
             // printf("%u ", mem_trace->cur_req->core_id);
             // printf("%u ", mem_trace->cur_req->req_type);
             // printf("%"PRIu64" \n", mem_trace->cur_req->memory_address);
         }
 
+        #ifdef EVENT_DRIVEN
+        bool accepted = false; // Some admission buffer moved a request to its channel
+        #endif
+        if (mem_system->admission != NULL)
+        {
+            #ifdef EVENT_DRIVEN
+            accepted = drainAdmissionBuffers(mem_system);
+            #else
+            drainAdmissionBuffers(mem_system);
+            #endif
+        }
+
+        #ifdef EVENT_DRIVEN
+        // No new request can enter the memory system, jump to the next memory
+        // cycle where any of the channels has work to do. A trace that ends with the
+        // memory system empty takes its last tick right away.
+        if ((end || stall) && !accepted && pendingRequests(mem_system))
+        {
+            cycles += fastForwardEvent(mem_system, nextSystemEvent(mem_system));
+        }
+        #endif
+
         tickEvent(mem_system);
         ++cycles;
     }
 
-    // TODO, de-allocate memory
-    /*
-    free(controller->bank_status);
-    free(controller->waiting_queue);
-    free(controller->pending_queue);
-    free(controller);
-    */
+    return cycles;
+}
+
+// Replay each core's requests alone (--alone). With the core model, the
+// slowdown of a core is how much its IPC proxy drops in the mix. An open-loop trace
+// issues at the same times either way, so all it shows is how much longer the reads
+// of a core take in the mix: their latency inflation, never below 1.
+void printSlowdowns(MemorySystem *mem_system, Core_Model *cores, bool closed_loop, bool parallel)
+{
+    unsigned num_cores = 0;
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        num_cores += (coreReadsDone(mem_system, i) > 0);
+    }
+    if (num_cores < 2)
+    {
+        return;
+    }
+
+    double weighted_speedup = 0;
+    double max_slowdown = 0;
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        if (coreReadsDone(mem_system, i) == 0)
+        {
+            continue;
+        }
+
+        MemorySystem *alone_system = initMemorySystem();
+        double slowdown;
+        if (closed_loop)
+        {
+            Core_Model *alone_cores = initCoreModel(openTrace, i);
+            runClosedLoop(alone_system, alone_cores);
+
+            double shared_ipc = coreIPC(cores, i);
+            double alone_ipc = coreIPC(alone_cores, i);
+            slowdown = alone_ipc / shared_ipc;
+            printf("Core %d: Shared IPC Proxy %f | Alone IPC Proxy %f | Slowdown %f\n",
+                   i, shared_ipc, alone_ipc, slowdown);
+            freeCoreModel(alone_cores);
+        }
+        else
+        {
+            replay(alone_system, openTrace(i), parallel);
+
+            double shared_latency = coreReadLatency(mem_system, i);
+            double alone_latency = coreReadLatency(alone_system, i);
+            slowdown = (shared_latency > alone_latency) ? shared_latency / alone_latency : 1.0;
+            printf("Core %d: Shared Read Latency %f | Alone Read Latency %f | "
+                   "Latency Inflation %f\n", i, shared_latency, alone_latency, slowdown);
+        }
+        freeMemorySystem(alone_system);
+
+        weighted_speedup += 1 / slowdown;
+        if (slowdown > max_slowdown)
+        {
+            max_slowdown = slowdown;
+        }
+    }
+    if (closed_loop)
+    {
+        printf("Weighted Speedup: %f\n", weighted_speedup);
+        printf("Maximum Slowdown: %f\n", max_slowdown);
+    }
+    else
+    {
+        printf("Maximum Latency Inflation: %f\n", max_slowdown);
+    }
+}
+
+int main(int argc, const char *argv[])
+{	
+    if (argc < 2)
+    {
+        printf("Usage: %s %s", argv[0], "<mem-file>|--load <rate>|--load-sweep <from:to:step> "
+               "[--arrival poisson|bursty] [--burst <n>] [--read-ratio <f>] [--locality <f>] "
+               "[--footprint <bytes>] [--load-requests <n>] [--seed <n>] [--load-csv <file>] "
+               "[--parallel] "
+               "[--mapping row:column:bank:channel (+rank, group)] [--interleave <bytes>] [--xor-bank] "
+               "[--write-high <n>] [--write-low <n>] [--latency-csv <file>] [--cycle-csv <file>] "
+               "[--pcm-channels <n>] [--dram-pages <n>] [--hot-threshold <n>] "
+               "[--closed-loop] [--mshr <n>] [--alone] [--admission <n>] [--reorder-window <n>] "
+               "[--mix-trace <file>]... [--mix-policy rr|timestamp|rate] [--mix-weights <w,w,...>] "
+               "[--timeline <file>] [--samples <file>] [--sample-epoch <n>] [--salp none|salp1|salp2|masa] [--subarrays <n>] "
+               "[--subarray-rows <n>] [--page-policy open|closed|adaptive] "
+               "[--refresh none|all-bank|per-bank] [--refresh-sched immediate|elastic] "
+               "[--refresh-postpone <n>] [--ranks <n>] [--bank-groups <n>] "
+               "[--timing ");
+        printTimingPresets();
+        printf("]\n");
+
+        return 0;
+    }
+
+    // Options
+    const char *timing_preset = "DDR4-2400";
+    bool parallel = false; // One thread per channel
+    const char *ordering = "row:column:bank:channel";
+    unsigned interleave = BLOCK_SIZE;
+    bool xor_bank = false;
+    const char *latency_csv = NULL; // Per type/channel/bank/core latency percentiles
+    const char *cycle_csv = NULL; // Per channel/bank/core cycle stacks
+    bool closed_loop = false; // Cores wait for their reads (Core.h)
+    bool alone = false; // Replay every core alone as well, for its slowdown
+    const char *weights = NULL;
+    const char *timeline = NULL; // Chrome trace-event JSON of the banks, buses and queues
+    const char *samples = NULL; // Bandwidth, queue and bank time series CSV
+    double load_rate = 0; // Synthetic open-loop load instead of a trace (Load_Generator.h)
+    const char *load_sweep = NULL;
+    const char *load_csv = NULL; // The latency-vs-offered-load curve
+    int i;
+
+    // Without a trace file, the options start right away.
+    int first_option = 1;
+    mix_files[0] = NULL;
+    if (strncmp(argv[1], "--", 2) != 0)
+    {
+        mix_files[0] = argv[1]; // With --mix-trace, the first trace of the mix
+        first_option = 2;
+    }
+    for (i = first_option; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc)
+        {
+            timing_preset = argv[++i];
+        }
+        else if (strcmp(argv[i], "--parallel") == 0)
+        {
+            parallel = true;
+        }
+        else if (strcmp(argv[i], "--mapping") == 0 && i + 1 < argc)
+        {
+            ordering = argv[++i];
+        }
+        else if (strcmp(argv[i], "--interleave") == 0 && i + 1 < argc)
+        {
+            interleave = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--xor-bank") == 0)
+        {
+            xor_bank = true;
+        }
+        else if (strcmp(argv[i], "--write-high") == 0 && i + 1 < argc)
+        {
+            WRITE_HIGH_WATERMARK = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--write-low") == 0 && i + 1 < argc)
+        {
+            WRITE_LOW_WATERMARK = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--latency-csv") == 0 && i + 1 < argc)
+        {
+            latency_csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cycle-csv") == 0 && i + 1 < argc)
+        {
+            cycle_csv = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pcm-channels") == 0 && i + 1 < argc)
+        {
+            NUM_OF_PCM_CHANNELS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dram-pages") == 0 && i + 1 < argc)
+        {
+            DRAM_PAGES = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--hot-threshold") == 0 && i + 1 < argc)
+        {
+            HOT_THRESHOLD = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--closed-loop") == 0)
+        {
+            closed_loop = true;
+        }
+        else if (strcmp(argv[i], "--alone") == 0)
+        {
+            alone = true;
+        }
+        else if (strcmp(argv[i], "--mshr") == 0 && i + 1 < argc)
+        {
+            MSHR_LIMIT = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--admission") == 0 && i + 1 < argc)
+        {
+            ADMISSION_BUFFER_SIZE = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--reorder-window") == 0 && i + 1 < argc)
+        {
+            REORDER_WINDOW = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--mix-trace") == 0 && i + 1 < argc)
+        {
+            num_mix_files = num_mix_files ? num_mix_files : 1;
+            if (num_mix_files == NUM_OF_CORES)
+            {
+                printf("A mix takes at most %u traces, one per core\n", NUM_OF_CORES);
+
+                return 0;
+            }
+            mix_files[num_mix_files++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--mix-policy") == 0 && i + 1 < argc)
+        {
+            ++i;
+            int policy = -1;
+            for (int j = 0; j < 3; j++)
+            {
+                if (strcmp(argv[i], mix_policy_names[j]) == 0)
+                {
+                    policy = j;
+                }
+            }
+            if (policy < 0)
+            {
+                printf("Unknown mix policy: %s\n", argv[i]);
+
+                return 0;
+            }
+            mix_policy = (Mix_Policy)policy;
+        }
+        else if (strcmp(argv[i], "--mix-weights") == 0 && i + 1 < argc)
+        {
+            weights = argv[++i];
+        }
+        else if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc)
+        {
+            timeline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+        {
+            samples = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sample-epoch") == 0 && i + 1 < argc)
+        {
+            SAMPLE_EPOCH = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--salp") == 0 && i + 1 < argc)
+        {
+            ++i;
+            int policy = -1;
+            for (int j = 0; j < NUM_OF_SUBARRAY_POLICIES; j++)
+            {
+                if (strcmp(argv[i], subarray_policy_names[j]) == 0)
+                {
+                    policy = j;
+                }
+            }
+            if (policy < 0)
+            {
+                printf("Unknown subarray policy: %s\n", argv[i]);
+
+                return 0;
+            }
+            subarray_policy = (Subarray_Policy)policy;
+        }
+        else if (strcmp(argv[i], "--subarrays") == 0 && i + 1 < argc)
+        {
+            NUM_OF_SUBARRAYS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--subarray-rows") == 0 && i + 1 < argc)
+        {
+            ROWS_PER_SUBARRAY = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--page-policy") == 0 && i + 1 < argc)
+        {
+            ++i;
+            int policy = -1;
+            for (int j = 0; j < NUM_OF_PAGE_POLICIES; j++)
+            {
+                if (strcmp(argv[i], page_policy_names[j]) == 0)
+                {
+                    policy = j;
+                }
+            }
+            if (policy < 0)
+            {
+                printf("Unknown page policy: %s\n", argv[i]);
+
+                return 0;
+            }
+            page_policy = (Page_Policy)policy;
+        }
+        else if (strcmp(argv[i], "--refresh") == 0 && i + 1 < argc)
+        {
+            ++i;
+            int mode = -1;
+            for (int j = 0; j < NUM_OF_REFRESH_MODES; j++)
+            {
+                if (strcmp(argv[i], refresh_mode_names[j]) == 0)
+                {
+                    mode = j;
+                }
+            }
+            if (mode < 0)
+            {
+                printf("Unknown refresh mode: %s\n", argv[i]);
+
+                return 0;
+            }
+            refresh_mode = (Refresh_Mode)mode;
+        }
+        else if (strcmp(argv[i], "--refresh-sched") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "immediate") != 0 && strcmp(argv[i], "elastic") != 0)
+            {
+                printf("Unknown refresh scheduling: %s\n", argv[i]);
+
+                return 0;
+            }
+            elastic_refresh = (strcmp(argv[i], "elastic") == 0);
+        }
+        else if (strcmp(argv[i], "--refresh-postpone") == 0 && i + 1 < argc)
+        {
+            REFRESH_POSTPONE_MAX = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ranks") == 0 && i + 1 < argc)
+        {
+            NUM_OF_RANKS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--bank-groups") == 0 && i + 1 < argc)
+        {
+            NUM_OF_BANK_GROUPS = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc)
+        {
+            load_rate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--load-sweep") == 0 && i + 1 < argc)
+        {
+            load_sweep = argv[++i];
+        }
+        else if (strcmp(argv[i], "--arrival") == 0 && i + 1 < argc)
+        {
+            ++i;
+            int process = -1;
+            for (int j = 0; j < NUM_OF_ARRIVAL_PROCESSES; j++)
+            {
+                if (strcmp(argv[i], arrival_process_names[j]) == 0)
+                {
+                    process = j;
+                }
+            }
+            if (process < 0)
+            {
+                printf("Unknown arrival process: %s\n", argv[i]);
+
+                return 0;
+            }
+            arrival_process = (Arrival_Process)process;
+        }
+        else if (strcmp(argv[i], "--burst") == 0 && i + 1 < argc)
+        {
+            LOAD_BURST = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--read-ratio") == 0 && i + 1 < argc)
+        {
+            LOAD_READ_RATIO = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--locality") == 0 && i + 1 < argc)
+        {
+            LOAD_LOCALITY = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--footprint") == 0 && i + 1 < argc)
+        {
+            LOAD_FOOTPRINT = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--load-requests") == 0 && i + 1 < argc)
+        {
+            LOAD_REQUESTS = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            LOAD_SEED = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--load-csv") == 0 && i + 1 < argc)
+        {
+            load_csv = argv[++i];
+        }
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+
+            return 0;
+        }
+    }
+
+    if (!loadTimingPreset(timing_preset))
+    {
+        printf("Unknown timing preset: %s\n", timing_preset);
+
+        return 0;
+    }
+
+    // The banks of a channel split evenly over the ranks and bank groups.
+    unsigned num_groups = NUM_OF_RANKS * NUM_OF_BANK_GROUPS;
+    if (NUM_OF_RANKS == 0 || NUM_OF_BANK_GROUPS == 0 || (NUM_OF_RANKS & (NUM_OF_RANKS - 1)) ||
+        (NUM_OF_BANK_GROUPS & (NUM_OF_BANK_GROUPS - 1)) || num_groups > NUM_OF_BANKS)
+    {
+        printf("--ranks and --bank-groups must be powers of two with at most %u bank groups "
+               "in a channel\n", NUM_OF_BANKS);
+
+        return 0;
+    }
+
+    if (!loadAddressMapping(ordering, interleave, xor_bank))
+    {
+        return 0;
+    }
+
+    if (NUM_OF_PCM_CHANNELS)
+    {
+        findTimingPreset("PCM", &pcm_timing);
+
+        if (NUM_OF_PCM_CHANNELS >= NUM_OF_CHANNELS || DRAM_PAGES == 0)
+        {
+            printf("A hybrid memory system needs at least one DRAM channel and one DRAM page\n");
+
+            return 0;
+        }
+
+        // Migrations tie the channels together, the channel threads cannot run apart.
+        if (parallel)
+        {
+            printf("--parallel does not support a hybrid memory system\n");
+
+            return 0;
+        }
+    }
+
+    if (closed_loop && (parallel || MSHR_LIMIT == 0))
+    {
+        // The cores tie the channels together, the channel threads cannot run apart.
+        printf("--closed-loop needs a non-zero --mshr and does not support --parallel\n");
+
+        return 0;
+    }
+
+    if (ADMISSION_BUFFER_SIZE && (parallel || closed_loop || REORDER_WINDOW == 0))
+    {
+        // The buffers let any channel take the next request, the channel threads could
+        // no longer follow the trace order. The cores already stall on their own.
+        printf("--admission needs a non-zero --reorder-window and does not support "
+               "--parallel or --closed-loop\n");
+
+        return 0;
+    }
+
+    // The synthetic load: one rate, or every rate of the sweep
+    double load_rates[1024];
+    unsigned num_load_rates = 0;
+    if (load_sweep != NULL)
+    {
+        unsigned max_load_rates = sizeof(load_rates) / sizeof(double);
+        double from, to, step;
+        bool valid = sscanf(load_sweep, "%lf:%lf:%lf", &from, &to, &step) == 3 && from > 0 &&
+                     to >= from && step > 0;
+
+        // The small slack keeps "to" in the sweep despite rounding.
+        size_t num_rates = valid ? (size_t)floor((to - from) / step + 1e-9) + 1 : 0;
+        if (!valid || num_rates > max_load_rates)
+        {
+            printf("--load-sweep needs from:to:step with 0 < from <= to and at most %u rates\n",
+                   max_load_rates);
+
+            return 0;
+        }
+        for (size_t j = 0; j < num_rates; j++)
+        {
+            load_rates[num_load_rates++] = from + j * step;
+        }
+    }
+    else if (load_rate > 0)
+    {
+        load_rates[num_load_rates++] = load_rate;
+    }
+
+    if (num_load_rates == 0 && mix_files[0] == NULL)
+    {
+        printf("A trace file is needed unless --load or --load-sweep is given\n");
+
+        return 0;
+    }
+
+    if (num_load_rates)
+    {
+        // The generator is the workload, and it ties the channels together.
+        if (mix_files[0] != NULL || num_mix_files || closed_loop || parallel || alone ||
+            ADMISSION_BUFFER_SIZE)
+        {
+            printf("--load and --load-sweep replace the trace and do not support --mix-trace, "
+                   "--closed-loop, --parallel, --alone or --admission\n");
+
+            return 0;
+        }
+
+        if (LOAD_READ_RATIO < 0 || LOAD_READ_RATIO > 1 || LOAD_LOCALITY < 0 ||
+            LOAD_LOCALITY > 1 || LOAD_BURST < 1 || LOAD_FOOTPRINT < BLOCK_SIZE ||
+            LOAD_REQUESTS == 0)
+        {
+            printf("The load needs --read-ratio and --locality in [0, 1], --burst >= 1, "
+                   "--footprint >= %u and non-zero --load-requests\n", BLOCK_SIZE);
+
+            return 0;
+        }
+
+        if (num_load_rates > 1 &&
+            (latency_csv != NULL || cycle_csv != NULL || timeline != NULL || samples != NULL))
+        {
+            printf("--latency-csv, --cycle-csv, --timeline and --samples take a single --load rate\n");
+
+            return 0;
+        }
+    }
+
+    // One weight per trace of the mix, all ones by default
+    for (i = 0; i < NUM_OF_CORES; i++)
+    {
+        mix_weights[i] = 1;
+    }
+    if (weights != NULL)
+    {
+        unsigned num_weights = 0;
+        const char *ptr = weights;
+        while (*ptr != '\0' && num_weights < NUM_OF_CORES)
+        {
+            mix_weights[num_weights++] = atoi(ptr);
+            ptr += strcspn(ptr, ",");
+            ptr += (*ptr == ',');
+        }
+
+        bool valid = (num_weights == num_mix_files && *ptr == '\0');
+        for (i = 0; i < num_weights; i++)
+        {
+            valid = valid && mix_weights[i] > 0 && mix_weights[i] <= MIX_RATE_STRIDE;
+        }
+        if (!valid)
+        {
+            printf("--mix-weights needs one positive weight per trace of the mix\n");
+
+            return 0;
+        }
+    }
+
+    // Check the traces open before the memory system is built
+    if (num_mix_files)
+    {
+        TraceParser *mix = initTraceMix(mix_files, num_mix_files, mix_policy, mix_weights);
+        if (mix == NULL)
+        {
+            printf("Cannot open a trace of the mix\n");
+
+            return 0;
+        }
+        closeTraceParser(mix);
+    }
+    else if (mix_files[0] != NULL)
+    {
+        TraceParser *mem_trace = initTraceParser(mix_files[0]);
+        bool opened = (mem_trace->fd != NULL);
+        closeTraceParser(mem_trace);
+        if (!opened)
+        {
+            printf("Cannot open the trace\n");
+
+            return 0;
+        }
+    }
+
+    if (NUM_OF_SUBARRAYS == 0 || ROWS_PER_SUBARRAY == 0)
+    {
+        printf("--subarrays and --subarray-rows must be non-zero\n");
+
+        return 0;
+    }
+
+    if (WRITE_LOW_WATERMARK >= WRITE_HIGH_WATERMARK || WRITE_HIGH_WATERMARK > MAX_WRITE_QUEUE_SIZE)
+    {
+        printf("Write watermarks must satisfy low < high <= %u\n", MAX_WRITE_QUEUE_SIZE);
+
+        return 0;
+    }
+
+    #ifndef TIMELINE
+    if (timeline != NULL)
+    {
+        printf("--timeline needs the TIMELINE switch of Controller.h\n");
+
+        return 0;
+    }
+    #endif
+
+    #ifndef SAMPLER
+    if (samples != NULL)
+    {
+        printf("--samples needs the SAMPLER switch of Controller.h\n");
+
+        return 0;
+    }
+    #endif
+    if (SAMPLE_EPOCH == 0 || SAMPLE_EPOCH > UINT32_MAX)
+    {
+        printf("--sample-epoch must be between 1 and %u memory clocks\n", UINT32_MAX);
+
+        return 0;
+    }
+
+    if (num_load_rates)
+    {
+        // A fresh memory system for every rate
+        Load_Point *points = (Load_Point *)malloc(num_load_rates * sizeof(Load_Point));
+        printLoadConfig();
+        for (i = 0; i < num_load_rates; i++)
+        {
+            MemorySystem *load_system = initMemorySystem();
+            if (timeline != NULL)
+            {
+                enableTimeline(load_system);
+            }
+            if (samples != NULL)
+            {
+                enableSampler(load_system);
+            }
+
+            Load_Generator *gen = initLoadGenerator(load_rates[i]);
+            uint64_t cycles = runLoad(load_system, gen);
+            measureLoad(load_system, gen, cycles, &(points[i]));
+            freeLoadGenerator(gen);
+            printLoadPoint(&(points[i]));
+
+            // A single rate gets the full stats as well
+            if (num_load_rates == 1)
+            {
+                printf("End Execution Time: ""%"PRIu64"\n", cycles);
+                printEnergySummary(load_system);
+                printMemorySystemStats(load_system);
+                if (latency_csv != NULL && !writeLatencyReport(load_system, latency_csv))
+                {
+                    printf("Cannot write the latency report to %s\n", latency_csv);
+                }
+                if (cycle_csv != NULL && !writeCycleReport(load_system, cycle_csv))
+                {
+                    printf("Cannot write the cycle report to %s\n", cycle_csv);
+                }
+                if (timeline != NULL && !writeTimeline(load_system, timeline))
+                {
+                    printf("Cannot write the timeline to %s\n", timeline);
+                }
+                if (samples != NULL && !writeSamples(load_system, samples))
+                {
+                    printf("Cannot write the samples to %s\n", samples);
+                }
+            }
+            freeMemorySystem(load_system);
+        }
+
+        if (load_csv != NULL && !writeLoadCurve(points, num_load_rates, load_csv))
+        {
+            printf("Cannot write the load curve to %s\n", load_csv);
+        }
+        free(points);
+
+        return 0;
+    }
+
+    // Initialize the memory system
+    MemorySystem *mem_system = initMemorySystem();
+    if (timeline != NULL)
+    {
+        enableTimeline(mem_system);
+    }
+    if (samples != NULL)
+    {
+        enableSampler(mem_system);
+    }
+
+    uint64_t cycles;
+    Core_Model *cores = NULL;
+    if (closed_loop)
+    {
+        // Every core reads its own requests from the trace
+        cores = initCoreModel(openTrace, -1);
+        cycles = runClosedLoop(mem_system, cores);
+    }
+    else
+    {
+        // Initialize a CPU trace parser
+        TraceParser *mem_trace = openTrace(-1);
+        cycles = replay(mem_system, mem_trace, parallel);
+    }
+
     printf("End Execution Time: ""%"PRIu64"\n", cycles);
+    printEnergySummary(mem_system);
+    if (num_mix_files)
+    {
+        printf("Trace Mix: %u traces | Policy: %s\n", num_mix_files, mix_policy_names[mix_policy]);
+    }
+    printMemorySystemStats(mem_system);
+    if (cores != NULL)
+    {
+        printCoreStats(cores);
+    }
+    if (latency_csv != NULL && !writeLatencyReport(mem_system, latency_csv))
+    {
+        printf("Cannot write the latency report to %s\n", latency_csv);
+    }
+    if (cycle_csv != NULL && !writeCycleReport(mem_system, cycle_csv))
+    {
+        printf("Cannot write the cycle report to %s\n", cycle_csv);
+    }
+    if (timeline != NULL && !writeTimeline(mem_system, timeline))
+    {
+        printf("Cannot write the timeline to %s\n", timeline);
+    }
+    if (samples != NULL && !writeSamples(mem_system, samples))
+    {
+        printf("Cannot write the samples to %s\n", samples);
+    }
+
+    if (alone)
+    {
+        printSlowdowns(mem_system, cores, closed_loop, parallel);
+    }
+
+    freeMemorySystem(mem_system);
+    if (cores != NULL)
+    {
+        freeCoreModel(cores);
+    }
+
+    return 0;
 }
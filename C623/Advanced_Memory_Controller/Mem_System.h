@@ -2,19 +2,62 @@
 #define __MEMORY_SYSTEM_HH__
 
 #include "Controller.h"
+#include "Address_Mapping.h"
+#include "Scheduler.h"
+#include "Hybrid.h"
 
-extern Controller *initController();
+extern Controller *initController(Timing *channel_timing);
+extern void freeController(Controller *controller);
 extern unsigned ongoingPendingRequests(Controller *controller);
 extern bool send(Controller *controller, Request *req);
 extern void tick(Controller *controller);
+extern uint64_t nextEvent(Controller *controller);
+extern uint64_t fastForward(Controller *controller, uint64_t target_clk);
+extern bool refreshEnabled(Controller *controller);
+extern void bankEnergy(Controller *controller, int bank_id, double *energy);
+extern void channelEnergy(Controller *controller, double *energy);
+
+extern void decodeAddress(Request *req);
+
+extern Tier_Manager *initTierManager();
+extern void freeTierManager(Tier_Manager *tiers);
+extern void translateAddress(Tier_Manager *tiers, Request *req);
+extern void recordPageAccess(Tier_Manager *tiers, Request *req);
+extern void injectMigrations(Tier_Manager *tiers, Controller **controllers);
+extern unsigned pendingMigrations(Tier_Manager *tiers);
+extern bool migrationReady(Tier_Manager *tiers, Controller **controllers);
+
+/*
+ * Admission buffers. Without them (ADMISSION_BUFFER_SIZE 0), a request whose channel
+ * queue is full stalls the trace, and with it every other channel. With them, each
+ * channel has a FIFO of ADMISSION_BUFFER_SIZE requests in front of its controller and
+ * the trace keeps flowing into the buffers of the other channels, at most
+ * REORDER_WINDOW requests past the oldest request that has not entered its controller.
+ * Every cycle, each buffer offers its oldest request to its controller.
+ */
+static unsigned ADMISSION_BUFFER_SIZE = 0; // requests per channel, 0 to stall the trace
+static unsigned REORDER_WINDOW = 32; // requests read ahead of the oldest one still buffered
+
+typedef struct Admission_Buffer
+{
+    Request *reqs; // Circular buffer of ADMISSION_BUFFER_SIZE requests
+    uint64_t *seqs; // Position of each request in the trace
+    unsigned head;
+    unsigned size;
+}Admission_Buffer;
 
 typedef struct MemorySystem
 {
     Controller **controllers; // All the channels/controllers in the memory system
 
-    /* For decoding */
-    unsigned channel_shift;
-    uint64_t channel_mask;
+    Tier_Manager *tiers; // Page placement of a hybrid DRAM + PCM system, NULL if all DRAM
+
+    /* Admission */
+    Admission_Buffer *admission; // One per channel, NULL without admission buffers
+    uint64_t next_admit_seq; // Position of the next request in the trace
+    bool frontend_blocked; // The trace waits for room in a buffer or in the window
+    uint64_t frontend_blocked_begin;
+    uint64_t frontend_blocked_cycles;
 }MemorySystem;
 
 MemorySystem *initMemorySystem()
@@ -25,15 +68,64 @@ MemorySystem *initMemorySystem()
     int i;
     for (i = 0; i < NUM_OF_CHANNELS; i++)
     {
-        mem_system->controllers[i] = initController();
+        // The PCM channels come last
+        bool pcm = (i >= NUM_OF_CHANNELS - NUM_OF_PCM_CHANNELS);
+        mem_system->controllers[i] = initController(pcm ? &pcm_timing : &timing);
     }
 
-    mem_system->channel_shift = log2(BLOCK_SIZE);
-    mem_system->channel_mask = (uint64_t)NUM_OF_CHANNELS - (uint64_t)1;
+    mem_system->tiers = NULL;
+    if (NUM_OF_PCM_CHANNELS)
+    {
+        mem_system->tiers = initTierManager();
+    }
+
+    mem_system->admission = NULL;
+    if (ADMISSION_BUFFER_SIZE)
+    {
+        mem_system->admission = (Admission_Buffer *)malloc(NUM_OF_CHANNELS * sizeof(Admission_Buffer));
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            Admission_Buffer *buffer = &(mem_system->admission[i]);
+            buffer->reqs = (Request *)malloc(ADMISSION_BUFFER_SIZE * sizeof(Request));
+            buffer->seqs = (uint64_t *)malloc(ADMISSION_BUFFER_SIZE * sizeof(uint64_t));
+            buffer->head = 0;
+            buffer->size = 0;
+        }
+    }
+    mem_system->next_admit_seq = 0;
+    mem_system->frontend_blocked = false;
+    mem_system->frontend_blocked_begin = 0;
+    mem_system->frontend_blocked_cycles = 0;
 
     return mem_system;
 }
 
+void freeMemorySystem(MemorySystem *mem_system)
+{
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        freeController(mem_system->controllers[i]);
+    }
+    free(mem_system->controllers);
+
+    if (mem_system->tiers != NULL)
+    {
+        freeTierManager(mem_system->tiers);
+    }
+
+    if (mem_system->admission != NULL)
+    {
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            free(mem_system->admission[i].reqs);
+            free(mem_system->admission[i].seqs);
+        }
+        free(mem_system->admission);
+    }
+    free(mem_system);
+}
+
 unsigned pendingRequests(MemorySystem *mem_system)
 {
     unsigned num_reqs_left = 0;
@@ -43,20 +135,136 @@ unsigned pendingRequests(MemorySystem *mem_system)
         num_reqs_left += ongoingPendingRequests(mem_system->controllers[i]);
     }
 
+    if (mem_system->tiers != NULL)
+    {
+        num_reqs_left += pendingMigrations(mem_system->tiers);
+    }
+
+    if (mem_system->admission != NULL)
+    {
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            num_reqs_left += mem_system->admission[i].size;
+        }
+    }
+
     return num_reqs_left;
 }
 
+unsigned decodeChannel(MemorySystem *mem_system, Request *req)
+{
+    if (mem_system->tiers != NULL)
+    {
+        translateAddress(mem_system->tiers, req);
+
+        return req->channel_id;
+    }
+
+    decodeAddress(req);
+
+    return req->channel_id;
+}
+
+// Hand an already decoded request to its channel
+bool sendToChannel(MemorySystem *mem_system, unsigned channel_id, Request *req)
+{
+    if (!send(mem_system->controllers[channel_id], req))
+    {
+        return false;
+    }
+
+    if (mem_system->tiers != NULL)
+    {
+        recordPageAccess(mem_system->tiers, req);
+    }
+
+    return true;
+}
+
 bool access(MemorySystem *mem_system, Request *req)
 {
-    unsigned channel_id = ((req->memory_address) >> mem_system->channel_shift) 
-        & mem_system->channel_mask;
+    unsigned channel_id = decodeChannel(mem_system, req);
 
-    req->channel_id = channel_id;
-    return send(mem_system->controllers[channel_id], req);
+    return sendToChannel(mem_system, channel_id, req);
+}
+
+void updateFrontendBlocked(MemorySystem *mem_system, bool admitted)
+{
+    uint64_t cur_clk = mem_system->controllers[0]->cur_clk;
+    if (!admitted && !mem_system->frontend_blocked)
+    {
+        mem_system->frontend_blocked = true;
+        mem_system->frontend_blocked_begin = cur_clk;
+    }
+    else if (admitted && mem_system->frontend_blocked)
+    {
+        mem_system->frontend_blocked = false;
+        mem_system->frontend_blocked_cycles += cur_clk - mem_system->frontend_blocked_begin;
+    }
+}
+
+// Put a request of the trace into its channel's admission buffer. Fails when the buffer
+// is full or the request is too far ahead of the oldest buffered one, the caller retries.
+// The channel is picked here, a hybrid page migrated in the meantime is still accessed
+// where it was.
+bool admit(MemorySystem *mem_system, Request *req)
+{
+    uint64_t oldest_seq = mem_system->next_admit_seq;
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Admission_Buffer *buffer = &(mem_system->admission[i]);
+        if (buffer->size && buffer->seqs[buffer->head] < oldest_seq)
+        {
+            oldest_seq = buffer->seqs[buffer->head];
+        }
+    }
+
+    unsigned channel_id = decodeChannel(mem_system, req);
+    Admission_Buffer *buffer = &(mem_system->admission[channel_id]);
+    if (buffer->size == ADMISSION_BUFFER_SIZE ||
+        mem_system->next_admit_seq - oldest_seq >= REORDER_WINDOW)
+    {
+        updateFrontendBlocked(mem_system, false);
+        return false;
+    }
+    updateFrontendBlocked(mem_system, true);
+
+    unsigned tail = (buffer->head + buffer->size) % ADMISSION_BUFFER_SIZE;
+    buffer->reqs[tail] = *req;
+    buffer->seqs[tail] = mem_system->next_admit_seq++;
+    ++buffer->size;
+
+    return true;
+}
+
+// Offer the oldest request of every admission buffer to its channel, returns whether
+// any channel took one.
+bool drainAdmissionBuffers(MemorySystem *mem_system)
+{
+    bool accepted = false;
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Admission_Buffer *buffer = &(mem_system->admission[i]);
+        if (buffer->size && sendToChannel(mem_system, i, &(buffer->reqs[buffer->head])))
+        {
+            buffer->head = (buffer->head + 1) % ADMISSION_BUFFER_SIZE;
+            --buffer->size;
+            accepted = true;
+        }
+    }
+
+    return accepted;
 }
 
 void tickEvent(MemorySystem *mem_system)
 {
+    if (mem_system->tiers != NULL)
+    {
+        injectMigrations(mem_system->tiers, mem_system->controllers);
+    }
+
     int i;
     for (i = 0; i < NUM_OF_CHANNELS; i++)
     {
@@ -64,4 +272,715 @@ void tickEvent(MemorySystem *mem_system)
     }
 }
 
+// All the channels share one memory clock, the next event of the system is the
+// earliest event among the channels.
+uint64_t nextSystemEvent(MemorySystem *mem_system)
+{
+    // Migration traffic enters the channels at the start of the next tick.
+    if (mem_system->tiers != NULL &&
+        migrationReady(mem_system->tiers, mem_system->controllers))
+    {
+        return mem_system->controllers[0]->cur_clk + 1;
+    }
+
+    uint64_t next_clk = UINT64_MAX;
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        uint64_t channel_next_clk = nextEvent(mem_system->controllers[i]);
+        if (channel_next_clk < next_clk)
+        {
+            next_clk = channel_next_clk;
+        }
+    }
+
+    return next_clk;
+}
+
+uint64_t fastForwardEvent(MemorySystem *mem_system, uint64_t target_clk)
+{
+    uint64_t skipped = 0;
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        skipped = fastForward(mem_system->controllers[i], target_clk);
+    }
+
+    return skipped;
+}
+
+uint64_t coreReadsDone(MemorySystem *mem_system, int core_id)
+{
+    uint64_t reads_done = 0;
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        reads_done += mem_system->controllers[i]->core_reads_done[core_id];
+    }
+
+    return reads_done;
+}
+
+// Average read latency (arrival to data) of a core over all the channels
+double coreReadLatency(MemorySystem *mem_system, int core_id)
+{
+    uint64_t read_latency = 0;
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        read_latency += mem_system->controllers[i]->core_read_latency[core_id];
+    }
+
+    uint64_t reads_done = coreReadsDone(mem_system, core_id);
+    return reads_done ? (double)read_latency / reads_done : 0.0;
+}
+
+void printHybridStats(MemorySystem *mem_system)
+{
+    Tier_Manager *tiers = mem_system->tiers;
+
+    printf("Hybrid Memory: DRAM Channels %u | PCM Channels %u | DRAM Pages %u | Page Size %u\n",
+           tiers->num_dram_channels, tiers->num_pcm_channels, DRAM_PAGES, PAGE_SIZE);
+
+    uint64_t num_accesses = tiers->dram_accesses + tiers->pcm_accesses;
+    printf("Tier Accesses (DRAM/PCM): ""%"PRIu64"/""%"PRIu64"\n",
+           tiers->dram_accesses, tiers->pcm_accesses);
+    printf("DRAM Hit Ratio: %f%%\n",
+           num_accesses ? (double)tiers->dram_accesses / num_accesses * 100 : 0.0);
+
+    // Every migration moves a page into DRAM, every eviction moves one back to PCM.
+    uint64_t migration_bytes = tiers->migration_requests * BLOCK_SIZE;
+    uint64_t cycles = mem_system->controllers[0]->cur_clk;
+    printf("Page Migrations: ""%"PRIu64" | Evictions: ""%"PRIu64"\n",
+           tiers->migrations, tiers->evictions);
+    printf("Migration Traffic: ""%"PRIu64" bytes | %f bytes/cycle | %f%% of all requests\n",
+           migration_bytes, cycles ? (double)migration_bytes / cycles : 0.0,
+           (num_accesses + tiers->migration_requests) ?
+           (double)tiers->migration_requests / (num_accesses + tiers->migration_requests) * 100 :
+           0.0);
+
+    uint64_t reads_done[2] = {0, 0}; // DRAM, PCM
+    uint64_t read_latency[2] = {0, 0};
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+        int tier = (i >= tiers->num_dram_channels);
+
+        reads_done[tier] += controller->reads_done[0] + controller->reads_done[1];
+        read_latency[tier] += controller->read_latency[0] + controller->read_latency[1];
+    }
+    printf("Average Read Latency (DRAM/PCM): %f/%f\n",
+           reads_done[0] ? (double)read_latency[0] / reads_done[0] : 0.0,
+           reads_done[1] ? (double)read_latency[1] / reads_done[1] : 0.0);
+}
+
+// Energy of the whole run, to go with the execution time
+void printEnergySummary(MemorySystem *mem_system)
+{
+    double energy = 0; // pJ
+    uint64_t num_requests = 0; // Served by a bank or straight from the queues
+    double channel_energy[NUM_OF_ENERGY_KINDS];
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+
+        channelEnergy(controller, channel_energy);
+        for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+        {
+            energy += channel_energy[k];
+        }
+
+        for (int j = 0; j < NUM_OF_BANKS; j++)
+        {
+            num_requests += controller->bank_requests[j];
+        }
+        num_requests += controller->coalesced_reads + controller->forwarded_reads;
+    }
+
+    // pJ / ns = mW
+    Controller *controller = mem_system->controllers[0];
+    double run_time = controller->cur_clk * controller->power.tck;
+    printf("Energy: %f nJ | Energy per Request: %f nJ | Average Power: %f mW\n", energy / 1000,
+           num_requests ? energy / 1000 / num_requests : 0.0, run_time ? energy / run_time : 0.0);
+}
+
+// One stall stack, the share of the cycles in each class
+void printCycleStack(const char *label, uint64_t *stack)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_OF_CYCLE_CLASSES; i++)
+    {
+        total += stack[i];
+    }
+
+    printf("%s:", label);
+    for (int i = 0; i < NUM_OF_CYCLE_CLASSES; i++)
+    {
+        printf("%s %s %f%%", i ? " |" : "", cycle_class_names[i],
+               total ? (double)stack[i] / total * 100 : 0.0);
+    }
+    printf("\n");
+}
+
+void printMemorySystemStats(MemorySystem *mem_system)
+{
+    uint64_t num_allocs = 0;
+    uint64_t num_mallocs = 0;
+    uint64_t row_hits = 0;
+    uint64_t row_misses = 0;
+    uint64_t row_conflicts = 0;
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+
+        num_allocs += controller->node_pool->num_allocs;
+        num_mallocs += controller->node_pool->num_mallocs;
+
+        row_hits += controller->row_hits;
+        row_misses += controller->row_misses;
+        row_conflicts += controller->row_conflicts;
+    }
+
+    printf("Timing Preset: %s\n", timing.name);
+    if (mem_system->tiers != NULL)
+    {
+        printf("PCM Timing Preset: %s\n", pcm_timing.name);
+    }
+    printf("Scheduler: %s\n", scheduler_name);
+    printf("Page Policy: %s\n", page_policy_names[page_policy]);
+
+    // Every node comes from the preallocated pools, mallocs should stay at zero.
+    printf("Node Pool Allocations: ""%"PRIu64"\n", num_allocs);
+    printf("Node Pool Mallocs: ""%"PRIu64"\n", num_mallocs);
+
+    uint64_t num_accesses = row_hits + row_misses + row_conflicts;
+    printf("Row Buffer Hits: ""%"PRIu64"\n", row_hits);
+    printf("Row Buffer Misses: ""%"PRIu64"\n", row_misses);
+    printf("Row Buffer Conflicts: ""%"PRIu64"\n", row_conflicts);
+    printf("Row Buffer Hit Rate: %f%%\n",
+           num_accesses ? (double)row_hits / (double)num_accesses * 100 : 0.0);
+
+    if (NUM_OF_RANKS > 1 || NUM_OF_BANK_GROUPS > 1)
+    {
+        uint64_t rank_switches = 0;
+        uint64_t same_group_cols = 0;
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            rank_switches += mem_system->controllers[i]->rank_switches;
+            same_group_cols += mem_system->controllers[i]->same_group_cols;
+        }
+        // Every bank access ends with one column command.
+        printf("Ranks: %u | Bank Groups: %u per rank | Banks: %u per group\n", NUM_OF_RANKS,
+               NUM_OF_BANK_GROUPS, NUM_OF_BANKS / (NUM_OF_RANKS * NUM_OF_BANK_GROUPS));
+        printf("Rank Switches: ""%"PRIu64" | Same Bank Group Column Commands: ""%"PRIu64" (%f%%)\n",
+               rank_switches, same_group_cols,
+               num_accesses ? (double)same_group_cols / num_accesses * 100 : 0.0);
+    }
+
+    if (page_policy != OPEN_PAGE)
+    {
+        uint64_t early_precharges = 0;
+        uint64_t wasted_precharges = 0;
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            early_precharges += mem_system->controllers[i]->early_precharges;
+            wasted_precharges += mem_system->controllers[i]->wasted_precharges;
+        }
+        // A wasted precharge turned what would have been a row hit into a row miss.
+        printf("Early Precharges: ""%"PRIu64" | Wasted: ""%"PRIu64" (%f%%)\n", early_precharges,
+               wasted_precharges,
+               early_precharges ? (double)wasted_precharges / early_precharges * 100 : 0.0);
+    }
+
+    if (refresh_mode != NO_REFRESH)
+    {
+        uint64_t refreshes = 0;
+        uint64_t postponed = 0;
+        uint64_t forced = 0;
+        uint64_t max_owed = 0;
+        uint64_t refresh_cycles = 0;
+        uint64_t bank_cycles = 0;
+        uint64_t stall_cycles = 0;
+        uint64_t stalled_requests = 0;
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            Controller *controller = mem_system->controllers[i];
+            refreshes += controller->refreshes_done;
+            postponed += controller->refreshes_postponed;
+            forced += controller->refreshes_forced;
+            max_owed = (controller->max_refreshes_owed > max_owed) ? controller->max_refreshes_owed :
+                                                                     max_owed;
+            refresh_cycles += controller->refresh_cycles;
+            if (refreshEnabled(controller))
+            {
+                bank_cycles += NUM_OF_BANKS * controller->cur_clk;
+            }
+            stall_cycles += controller->refresh_stall_cycles;
+            stalled_requests += controller->refresh_stalled_requests;
+        }
+        printf("Refresh: %s | Scheduling: %s", refresh_mode_names[refresh_mode],
+               elastic_refresh ? "elastic" : "immediate");
+        if (elastic_refresh)
+        {
+            printf(" (at most %u owed)", REFRESH_POSTPONE_MAX);
+        }
+        printf("\n");
+        printf("Refreshes: ""%"PRIu64" | Postponed: ""%"PRIu64" | Forced: ""%"PRIu64" | "
+               "Max Owed: ""%"PRIu64"\n", refreshes, postponed, forced, max_owed);
+        printf("Refresh Bank Time: %f%%\n",
+               bank_cycles ? (double)refresh_cycles / bank_cycles * 100 : 0.0);
+        printf("Refresh Stall Cycles: ""%"PRIu64" | Requests Stalled: ""%"PRIu64"\n",
+               stall_cycles, stalled_requests);
+    }
+
+    if (subarray_policy != SALP_NONE)
+    {
+        uint64_t subarray_overlaps = 0;
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            subarray_overlaps += mem_system->controllers[i]->subarray_overlaps;
+        }
+        printf("Subarrays: %u per bank | Rows per Subarray: %u | Policy: %s\n", NUM_OF_SUBARRAYS,
+               ROWS_PER_SUBARRAY, subarray_policy_names[subarray_policy]);
+        printf("Subarray-Parallel Activates: ""%"PRIu64"\n", subarray_overlaps);
+    }
+
+    // Reads that never reached a bank
+    uint64_t coalesced_reads = 0;
+    uint64_t forwarded_reads = 0;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        coalesced_reads += mem_system->controllers[i]->coalesced_reads;
+        forwarded_reads += mem_system->controllers[i]->forwarded_reads;
+    }
+    printf("Coalesced Reads: ""%"PRIu64"\n", coalesced_reads);
+    printf("Forwarded Reads: ""%"PRIu64"\n", forwarded_reads);
+
+    printf("Address Mapping: %s | Interleave: %u | XOR Bank: %s\n", mapping.ordering,
+           mapping.interleave, mapping.xor_bank ? "yes" : "no");
+
+    // Per-bank request histogram, max/mean shows how hot the hottest bank is.
+    uint64_t max_bank_requests = 0;
+    uint64_t total_bank_requests = 0;
+    printf("Bank Requests:\n");
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+
+        printf("Channel %d:", i);
+        for (int j = 0; j < NUM_OF_BANKS; j++)
+        {
+            printf(" %"PRIu64, controller->bank_requests[j]);
+
+            total_bank_requests += controller->bank_requests[j];
+            if (controller->bank_requests[j] > max_bank_requests)
+            {
+                max_bank_requests = controller->bank_requests[j];
+            }
+        }
+        printf("\n");
+    }
+    double mean_bank_requests = (double)total_bank_requests / (NUM_OF_CHANNELS * NUM_OF_BANKS);
+    printf("Bank Imbalance (max/mean): %f\n",
+           total_bank_requests ? (double)max_bank_requests / mean_bank_requests : 0.0);
+
+    // Cycles each channel turned requests away for a full queue
+    if (mem_system->admission != NULL)
+    {
+        printf("Admission Buffers: %u | Reorder Window: %u | Frontend Blocked Cycles: ""%"PRIu64"\n",
+               ADMISSION_BUFFER_SIZE, REORDER_WINDOW, mem_system->frontend_blocked_cycles);
+    }
+    printf("Channel Blocked Cycles:");
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        printf(" %"PRIu64, mem_system->controllers[i]->blocked_cycles);
+    }
+    printf("\n");
+
+    // Energy by command and background, per channel and per bank
+    double energy[NUM_OF_ENERGY_KINDS];
+    double total_energy[NUM_OF_ENERGY_KINDS];
+    double sum_energy = 0;
+    for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+    {
+        total_energy[k] = 0;
+    }
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        channelEnergy(mem_system->controllers[i], energy);
+        for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+        {
+            total_energy[k] += energy[k];
+            sum_energy += energy[k];
+        }
+    }
+    printf("Energy Breakdown:");
+    for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+    {
+        printf("%s %s %f nJ (%f%%)", k ? " |" : "", energy_kind_names[k], total_energy[k] / 1000,
+               sum_energy ? total_energy[k] / sum_energy * 100 : 0.0);
+    }
+    printf("\n");
+
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+
+        channelEnergy(controller, energy);
+        double channel_energy = 0;
+        for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+        {
+            channel_energy += energy[k];
+        }
+        double run_time = controller->cur_clk * controller->power.tck;
+        printf("Channel %d Energy: %f nJ | Average Power: %f mW\n", i, channel_energy / 1000,
+               run_time ? channel_energy / run_time : 0.0);
+    }
+
+    printf("Bank Energy (nJ):\n");
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        printf("Channel %d:", i);
+        for (int j = 0; j < NUM_OF_BANKS; j++)
+        {
+            bankEnergy(mem_system->controllers[i], j, energy);
+            double bank_energy = 0;
+            for (int k = 0; k < NUM_OF_ENERGY_KINDS; k++)
+            {
+                bank_energy += energy[k];
+            }
+            printf(" %.1f", bank_energy / 1000);
+        }
+        printf("\n");
+    }
+
+    // Where the cycles of the channels go, per channel and per core. Per-bank stacks only
+    // go to the CSV report.
+    uint64_t cycle_stack[NUM_OF_CYCLE_CLASSES];
+    for (int k = 0; k < NUM_OF_CYCLE_CLASSES; k++)
+    {
+        cycle_stack[k] = 0;
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            cycle_stack[k] += mem_system->controllers[i]->cycle_stack[k];
+        }
+    }
+    printCycleStack("Cycle Stack", cycle_stack);
+
+    char stack_label[32];
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        sprintf(stack_label, "Channel %d Cycle Stack", i);
+        printCycleStack(stack_label, mem_system->controllers[i]->cycle_stack);
+    }
+
+    // A core gets the cycles other than idle in which its request was issued or waited first.
+    for (int j = 0; j < NUM_OF_CORES; j++)
+    {
+        uint64_t core_cycles = 0;
+        for (int k = 0; k < NUM_OF_CYCLE_CLASSES; k++)
+        {
+            cycle_stack[k] = 0;
+            for (i = 0; i < NUM_OF_CHANNELS; i++)
+            {
+                cycle_stack[k] += mem_system->controllers[i]->core_cycle_stack[j * NUM_OF_CYCLE_CLASSES + k];
+            }
+            core_cycles += cycle_stack[k];
+        }
+
+        if (core_cycles)
+        {
+            sprintf(stack_label, "Core %d Cycle Stack", j);
+            printCycleStack(stack_label, cycle_stack);
+        }
+    }
+
+    // Write draining, and what it costs the reads caught behind it
+    uint64_t drain_episodes = 0;
+    uint64_t drain_cycles = 0;
+    uint64_t writes_issued = 0;
+    uint64_t reads_done[2] = {0, 0};
+    uint64_t read_latency[2] = {0, 0};
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+
+        drain_episodes += controller->drain_episodes;
+        drain_cycles += controller->drain_cycles;
+        if (controller->draining)
+        {
+            drain_cycles += controller->cur_clk - controller->drain_begin;
+        }
+        writes_issued += controller->writes_issued;
+
+        for (int j = 0; j < 2; j++)
+        {
+            reads_done[j] += controller->reads_done[j];
+            read_latency[j] += controller->read_latency[j];
+        }
+    }
+
+    printf("Write Watermarks (low/high): %u/%u\n", WRITE_LOW_WATERMARK, WRITE_HIGH_WATERMARK);
+    printf("Write Drain Episodes: ""%"PRIu64"\n", drain_episodes);
+    printf("Write Drain Cycles: ""%"PRIu64"\n", drain_cycles);
+    printf("Writes Issued: ""%"PRIu64"\n", writes_issued);
+    printf("Average Read Latency: %f\n", (reads_done[0] + reads_done[1]) ?
+           (double)(read_latency[0] + read_latency[1]) / (reads_done[0] + reads_done[1]) : 0.0);
+    printf("Average Read Latency (no drain): %f | Reads: ""%"PRIu64"\n",
+           reads_done[0] ? (double)read_latency[0] / reads_done[0] : 0.0, reads_done[0]);
+    printf("Average Read Latency (during drain): %f | Reads: ""%"PRIu64"\n",
+           reads_done[1] ? (double)read_latency[1] / reads_done[1] : 0.0, reads_done[1]);
+
+    uint64_t num_batches = 0;
+    uint64_t blacklistings = 0;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        num_batches += mem_system->controllers[i]->num_batches;
+        blacklistings += mem_system->controllers[i]->blacklistings;
+    }
+    #ifdef PAR_BS
+    printf("PAR-BS Batches: ""%"PRIu64"\n", num_batches);
+    #endif
+    #ifdef BLISS
+    printf("BLISS Blacklistings: ""%"PRIu64"\n", blacklistings);
+    #endif
+
+    for (i = 0; i < NUM_OF_CORES; i++)
+    {
+        if (coreReadsDone(mem_system, i))
+        {
+            printf("Core %d: Reads ""%"PRIu64" | Average Read Latency %f\n", i,
+                   coreReadsDone(mem_system, i), coreReadLatency(mem_system, i));
+        }
+    }
+
+    // Tail latency, in memory clocks. Per-bank histograms only go to the CSV report.
+    printf("Latency Percentiles (memory clocks):\n");
+    Latency_Histogram *type_latency = (Latency_Histogram *)malloc(2 * sizeof(Latency_Histogram));
+    initLatencyHistogram(&(type_latency[READ]));
+    initLatencyHistogram(&(type_latency[WRITE]));
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        mergeLatencyHistogram(&(type_latency[READ]), &(mem_system->controllers[i]->type_latency[READ]));
+        mergeLatencyHistogram(&(type_latency[WRITE]), &(mem_system->controllers[i]->type_latency[WRITE]));
+    }
+    printLatencyHistogram("Read", &(type_latency[READ]));
+    printLatencyHistogram("Write", &(type_latency[WRITE]));
+    free(type_latency);
+
+    char label[32];
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        sprintf(label, "Channel %d", i);
+        printLatencyHistogram(label, &(mem_system->controllers[i]->channel_latency));
+    }
+
+    Latency_Histogram *core_latency = (Latency_Histogram *)malloc(sizeof(Latency_Histogram));
+    for (int j = 0; j < NUM_OF_CORES; j++)
+    {
+        initLatencyHistogram(core_latency);
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            mergeLatencyHistogram(core_latency, &(mem_system->controllers[i]->core_latency[j]));
+        }
+
+        if (core_latency->queueing.total)
+        {
+            sprintf(label, "Core %d", j);
+            printLatencyHistogram(label, core_latency);
+        }
+    }
+    free(core_latency);
+
+    if (mem_system->tiers != NULL)
+    {
+        printHybridStats(mem_system);
+    }
+}
+
+// Record a timeline of every channel from now on (Timeline.h)
+void enableTimeline(MemorySystem *mem_system)
+{
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        mem_system->controllers[i]->timeline = initTimeline();
+    }
+}
+
+// The recorded timelines as a Chrome trace-event JSON file
+bool writeTimeline(MemorySystem *mem_system, const char *path)
+{
+    FILE *fd = fopen(path, "w");
+    if (fd == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fd, "{\"traceEvents\":[\n");
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        writeChannelTimeline(fd, mem_system->controllers[i]->timeline, i, NUM_OF_BANKS);
+    }
+    fprintf(fd, "\n],\n\"displayTimeUnit\":\"ns\",\n"
+            "\"otherData\":{\"timestamps\":\"memory clocks\",\"timing\":\"%s\"}}\n", timing.name);
+
+    fclose(fd);
+    return true;
+}
+
+// Sample every channel from now on (Sampler.h)
+void enableSampler(MemorySystem *mem_system)
+{
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+        controller->sampler = initSampler(NUM_OF_BANKS, controller->cur_clk + 1);
+    }
+}
+
+// The samples as CSV, channel by channel, the epoch cut short by the end of the run included
+bool writeSamples(MemorySystem *mem_system, const char *path)
+{
+    FILE *fd = fopen(path, "w");
+    if (fd == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fd, "channel,clk,cycles,reads,writes,read_fraction,bandwidth_gbps,read_queue,write_queue");
+    for (int j = 0; j < NUM_OF_BANKS; j++)
+    {
+        fprintf(fd, ",bank_%d_busy", j);
+    }
+    fprintf(fd, "\n");
+
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        Controller *controller = mem_system->controllers[i];
+        if (controller->cur_clk >= controller->sampler->epoch_begin)
+        {
+            closeSample(controller->sampler, controller->cur_clk);
+        }
+        writeChannelSamples(fd, controller->sampler, i, controller->power.tck, BLOCK_SIZE);
+    }
+
+    fclose(fd);
+    return true;
+}
+
+// Every latency histogram (per type, channel, bank and core) as CSV rows
+bool writeLatencyReport(MemorySystem *mem_system, const char *path)
+{
+    FILE *fd = fopen(path, "w");
+    if (fd == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fd, "group,id,metric,count,mean,p50,p95,p99,p99.9,max\n");
+
+    Latency_Histogram *merged = (Latency_Histogram *)malloc(sizeof(Latency_Histogram));
+    int i;
+    for (int type = READ; type <= WRITE; type++)
+    {
+        initLatencyHistogram(merged);
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            mergeLatencyHistogram(merged, &(mem_system->controllers[i]->type_latency[type]));
+        }
+        writeLatencyCSV(fd, (type == READ) ? "read" : "write", -1, merged);
+    }
+
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        writeLatencyCSV(fd, "channel", i, &(mem_system->controllers[i]->channel_latency));
+    }
+
+    // Banks are numbered across the channels: channel * NUM_OF_BANKS + bank
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        for (int j = 0; j < NUM_OF_BANKS; j++)
+        {
+            writeLatencyCSV(fd, "bank", i * NUM_OF_BANKS + j,
+                            &(mem_system->controllers[i]->bank_latency[j]));
+        }
+    }
+
+    for (int j = 0; j < NUM_OF_CORES; j++)
+    {
+        initLatencyHistogram(merged);
+        for (i = 0; i < NUM_OF_CHANNELS; i++)
+        {
+            mergeLatencyHistogram(merged, &(mem_system->controllers[i]->core_latency[j]));
+        }
+        writeLatencyCSV(fd, "core", j, merged);
+    }
+    free(merged);
+
+    fclose(fd);
+    return true;
+}
+
+void writeCycleCSV(FILE *fd, const char *group, int id, uint64_t *stack)
+{
+    fprintf(fd, "%s,%d", group, id);
+    for (int i = 0; i < NUM_OF_CYCLE_CLASSES; i++)
+    {
+        fprintf(fd, ",%"PRIu64, stack[i]);
+    }
+    fprintf(fd, "\n");
+}
+
+// Every cycle stack (per channel, bank and core) as CSV rows of cycle counts
+bool writeCycleReport(MemorySystem *mem_system, const char *path)
+{
+    FILE *fd = fopen(path, "w");
+    if (fd == NULL)
+    {
+        return false;
+    }
+
+    fprintf(fd, "group,id,idle,draining,issuing,queue_full,bank_busy,channel_bus\n");
+
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        writeCycleCSV(fd, "channel", i, mem_system->controllers[i]->cycle_stack);
+    }
+
+    // Banks are numbered across the channels: channel * NUM_OF_BANKS + bank
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        for (int j = 0; j < NUM_OF_BANKS; j++)
+        {
+            writeCycleCSV(fd, "bank", i * NUM_OF_BANKS + j,
+                          &(mem_system->controllers[i]->bank_cycle_stack[j * NUM_OF_CYCLE_CLASSES]));
+        }
+    }
+
+    uint64_t stack[NUM_OF_CYCLE_CLASSES];
+    for (int j = 0; j < NUM_OF_CORES; j++)
+    {
+        for (int k = 0; k < NUM_OF_CYCLE_CLASSES; k++)
+        {
+            stack[k] = 0;
+            for (i = 0; i < NUM_OF_CHANNELS; i++)
+            {
+                stack[k] += mem_system->controllers[i]->core_cycle_stack[j * NUM_OF_CYCLE_CLASSES + k];
+            }
+        }
+        writeCycleCSV(fd, "core", j, stack);
+    }
+
+    fclose(fd);
+    return true;
+}
+
 #endif
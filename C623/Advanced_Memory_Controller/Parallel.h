@@ -0,0 +1,336 @@
+#ifndef __PARALLEL_HH__
+#define __PARALLEL_HH__
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#include "Trace.h"
+#include "Mem_System.h"
+
+extern bool getRequest(TraceParser *mem_trace);
+
+extern unsigned decodeChannel(MemorySystem *mem_system, Request *req);
+
+/*
+ * Parallel mode: every channel runs on its own thread and the trace reader (main
+ * thread) hands each request to its channel through a single-producer single-consumer
+ * ring.
+ *
+ * In the serial loop, request i is offered to its channel every cycle from the cycle
+ * after request i-1 is accepted until the channel accepts it. The channels therefore
+ * only depend on each other through the cycle each request is first offered. A channel
+ * queue only loses requests as time goes on, so the room it has at its current clock,
+ * less the requests sent to it since, is still there at any later cycle. The reader
+ * keeps that count for every channel: a request that fits is accepted the cycle it is
+ * offered, and the reader stamps it with that cycle and moves on to the next one
+ * without waiting. Only a request that may find its queue full is resolved by its
+ * channel, which retries it exactly as the serial stall does while the reader waits.
+ * Every channel sees the same arrivals at the same cycles as the serial run.
+ *
+ * The reader publishes the ring tails and the frontier, a lower bound of the cycle
+ * the next requests are offered at, once per batch of PARALLEL_BATCH requests and
+ * whenever it has to wait. A channel runs through the stamped requests of its ring
+ * and, once it is empty, ahead up to the frontier.
+ */
+
+static unsigned RING_SIZE = 4096; // requests buffered per channel, power of two
+static unsigned PARALLEL_BATCH = 256; // requests read between two publications
+
+// A request on its way to a channel, tagged with its position in the trace
+typedef struct Ring_Entry
+{
+    Request req;
+    uint64_t seq;
+    uint64_t offer_clk; // The cycle the request is first offered at
+    bool resolve; // It may not fit, the channel tells the reader when it is accepted
+}Ring_Entry;
+
+typedef struct Request_Ring
+{
+    Ring_Entry *entries;
+    uint64_t mask;
+
+    _Atomic uint64_t head; // Next entry to consume, only written by the channel
+    _Atomic uint64_t tail; // Next entry to produce, only written by the trace reader
+}Request_Ring;
+
+// State shared by the trace reader and all the channels
+typedef struct Parallel_Feed
+{
+    _Atomic uint64_t resolved; // Number of requests accepted so far, after a resolve
+    _Atomic uint64_t frontier; // Lower bound of the cycle the next requests are offered at
+    _Atomic bool feed_done; // The trace reader has pushed every request
+}Parallel_Feed;
+
+typedef struct Channel_Worker
+{
+    pthread_t thread;
+
+    Controller *controller;
+    Request_Ring ring;
+    Parallel_Feed *feed;
+
+    // Room of each queue, as the number of requests of the type consumed so far plus
+    // the free entries of the queue. Only written by the channel, it never decreases.
+    _Atomic uint64_t room[2];
+    uint64_t consumed[2];
+
+    uint64_t done_clk; // The memory clock the channel finished its last request
+}Channel_Worker;
+
+// Run the controller up to memory clock limit, knowing that no request arrives before.
+void advanceChannel(Controller *controller, uint64_t limit)
+{
+    while (controller->cur_clk < limit)
+    {
+        #ifdef EVENT_DRIVEN
+        uint64_t next_clk = nextEvent(controller);
+        fastForward(controller, (next_clk < limit) ? next_clk : limit);
+        #endif
+
+        tick(controller);
+    }
+}
+
+void publishRoom(Channel_Worker *worker)
+{
+    Controller *controller = worker->controller;
+
+    atomic_store_explicit(&worker->room[READ], worker->consumed[READ] + MAX_WAITING_QUEUE_SIZE -
+                          controller->read_queue->queue->size, memory_order_release);
+    atomic_store_explicit(&worker->room[WRITE], worker->consumed[WRITE] + MAX_WRITE_QUEUE_SIZE -
+                          controller->write_queue->queue->size, memory_order_release);
+}
+
+void *runChannel(void *arg)
+{
+    Channel_Worker *worker = (Channel_Worker *)arg;
+    Controller *controller = worker->controller;
+    Request_Ring *ring = &(worker->ring);
+    Parallel_Feed *feed = worker->feed;
+
+    while (true)
+    {
+        // The tails are published before the frontier, read in the other order so that
+        // no request below the frontier is missed.
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        bool feed_done = atomic_load_explicit(&feed->feed_done, memory_order_acquire);
+        uint64_t limit = atomic_load_explicit(&feed->frontier, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (head == tail && feed_done)
+        {
+            break;
+        }
+
+        // Nothing for us yet, run up to the frontier.
+        if (head == tail)
+        {
+            if (controller->cur_clk < limit)
+            {
+                advanceChannel(controller, limit);
+                publishRoom(worker);
+            }
+            else
+            {
+                sched_yield();
+            }
+            continue;
+        }
+
+        // Run through the requests pushed so far, each at the cycle it is offered at
+        for (; head != tail; head++)
+        {
+            Ring_Entry *entry = &(ring->entries[head & ring->mask]);
+            advanceChannel(controller, entry->offer_clk);
+
+            if (!entry->resolve)
+            {
+                // The reader has made sure it fits
+                bool accepted = send(controller, &(entry->req));
+                assert(accepted);
+            }
+            else
+            {
+                while (!send(controller, &(entry->req)))
+                {
+                    #ifdef EVENT_DRIVEN
+                    fastForward(controller, nextEvent(controller));
+                    #endif
+
+                    tick(controller);
+
+                    // Still stalled, the requests after it are offered later than this.
+                    atomic_store_explicit(&feed->frontier, controller->cur_clk + 1,
+                                          memory_order_release);
+                }
+
+                // The requests after it are offered from the next cycle on.
+                atomic_store_explicit(&feed->frontier, controller->cur_clk + 1, memory_order_release);
+                atomic_store_explicit(&feed->resolved, entry->seq + 1, memory_order_release);
+            }
+            ++worker->consumed[entry->req.req_type];
+
+            tick(controller);
+            publishRoom(worker);
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release); // Entries are free now
+    }
+
+    // No more requests for this channel, finish the ones in flight.
+    while (ongoingPendingRequests(controller))
+    {
+        #ifdef EVENT_DRIVEN
+        fastForward(controller, nextEvent(controller));
+        #endif
+
+        tick(controller);
+    }
+    worker->done_clk = controller->cur_clk;
+
+    return NULL;
+}
+
+// Make the requests read so far and the frontier visible to the channels
+void publishFeed(Channel_Worker *workers, uint64_t *tails, uint64_t offer_clk)
+{
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        atomic_store_explicit(&(workers[i].ring.tail), tails[i], memory_order_release);
+    }
+    atomic_store_explicit(&(workers[0].feed->frontier), offer_clk, memory_order_release);
+}
+
+// Replay the whole trace with one thread per channel, returns the execution time.
+uint64_t runParallel(MemorySystem *mem_system, TraceParser *mem_trace)
+{
+    assert((RING_SIZE & (RING_SIZE - 1)) == 0);
+    assert(PARALLEL_BATCH > 0 && PARALLEL_BATCH <= RING_SIZE);
+
+    Parallel_Feed feed;
+    atomic_init(&feed.resolved, 0);
+    atomic_init(&feed.frontier, 0);
+    atomic_init(&feed.feed_done, false);
+
+    Channel_Worker *workers = (Channel_Worker *)malloc(NUM_OF_CHANNELS * sizeof(Channel_Worker));
+    uint64_t *tails = (uint64_t *)malloc(NUM_OF_CHANNELS * sizeof(uint64_t));
+    uint64_t *sent = (uint64_t *)calloc(2 * NUM_OF_CHANNELS, sizeof(uint64_t)); // Per queue
+    uint64_t *room = (uint64_t *)malloc(2 * NUM_OF_CHANNELS * sizeof(uint64_t)); // Last seen
+    int i;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        workers[i].controller = mem_system->controllers[i];
+        workers[i].ring.entries = (Ring_Entry *)malloc(RING_SIZE * sizeof(Ring_Entry));
+        workers[i].ring.mask = RING_SIZE - 1;
+        atomic_init(&(workers[i].ring.head), 0);
+        atomic_init(&(workers[i].ring.tail), 0);
+        workers[i].feed = &feed;
+        workers[i].consumed[READ] = 0;
+        workers[i].consumed[WRITE] = 0;
+        atomic_init(&(workers[i].room[READ]), 0);
+        atomic_init(&(workers[i].room[WRITE]), 0);
+        publishRoom(&workers[i]);
+        workers[i].done_clk = 0;
+        tails[i] = 0;
+        room[2 * i + READ] = atomic_load(&(workers[i].room[READ]));
+        room[2 * i + WRITE] = atomic_load(&(workers[i].room[WRITE]));
+
+        pthread_create(&(workers[i].thread), NULL, runChannel, &workers[i]);
+    }
+
+    // Feed the rings in trace order
+    uint64_t seq = 0;
+    uint64_t offer_clk = 0; // The cycle the next request is first offered at
+    unsigned batched = 0;
+    while (getRequest(mem_trace))
+    {
+        unsigned channel_id = decodeChannel(mem_system, mem_trace->cur_req);
+        Request_Type req_type = mem_trace->cur_req->req_type;
+        Request_Ring *ring = &(workers[channel_id].ring);
+
+        uint64_t tail = tails[channel_id];
+        if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == RING_SIZE)
+        {
+            publishFeed(workers, tails, offer_clk);
+            batched = 0;
+            while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == RING_SIZE)
+            {
+                sched_yield();
+            }
+        }
+
+        // Does the request surely find room in its queue?
+        uint64_t *known_room = &(room[2 * channel_id + req_type]);
+        uint64_t *num_sent = &(sent[2 * channel_id + req_type]);
+        if (*num_sent >= *known_room)
+        {
+            *known_room = atomic_load_explicit(&(workers[channel_id].room[req_type]),
+                                               memory_order_acquire);
+        }
+        bool resolve = (*num_sent >= *known_room);
+        ++(*num_sent);
+
+        Ring_Entry *entry = &(ring->entries[tail & ring->mask]);
+        entry->req = *(mem_trace->cur_req);
+        entry->seq = seq++;
+        entry->offer_clk = offer_clk;
+        entry->resolve = resolve;
+        tails[channel_id] = tail + 1;
+
+        if (resolve)
+        {
+            // Wait for the channel to accept it, the next request is offered right after.
+            publishFeed(workers, tails, offer_clk);
+            batched = 0;
+            while (atomic_load_explicit(&feed.resolved, memory_order_acquire) != seq)
+            {
+                sched_yield();
+            }
+            offer_clk = atomic_load_explicit(&feed.frontier, memory_order_acquire);
+        }
+        else
+        {
+            offer_clk = offer_clk + 1;
+            if (++batched == PARALLEL_BATCH)
+            {
+                publishFeed(workers, tails, offer_clk);
+                batched = 0;
+            }
+        }
+    }
+    publishFeed(workers, tails, offer_clk);
+    atomic_store_explicit(&feed.feed_done, true, memory_order_release);
+
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    // The serial loop sees the end of the trace one cycle after the last request is
+    // accepted and stops once every channel has finished.
+    uint64_t cycles = atomic_load(&feed.frontier) + 1;
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        if (workers[i].done_clk > cycles)
+        {
+            cycles = workers[i].done_clk;
+        }
+    }
+
+    // Bring every channel to the common end clock, as the serial loop does.
+    for (i = 0; i < NUM_OF_CHANNELS; i++)
+    {
+        advanceChannel(mem_system->controllers[i], cycles);
+        free(workers[i].ring.entries);
+    }
+    free(workers);
+    free(tails);
+    free(sent);
+    free(room);
+
+    return cycles;
+}
+
+#endif
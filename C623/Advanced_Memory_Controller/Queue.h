@@ -3,6 +3,7 @@
 
 #include <assert.h>
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -15,31 +16,134 @@ struct Node;
 typedef struct Node Node;
 typedef struct Node
 {
+    int core_id; // The core sends the request
     uint64_t mem_addr;
     Request_Type req_type; // Request type
 
     int channel_id;
     int bank_id; // Which bank the request targets to
+    uint64_t row_id; // Which row of the bank the request targets to
+
+    uint64_t seq; // Arrival order within the channel
 
     // Some timing informations.
+    uint64_t arrival;
     uint64_t begin_exe;
     uint64_t end_exe;
 
+    bool saw_drain; // A read that waited while writes were being drained
+    bool marked; // Part of the current PAR-BS batch
+    bool migration; // Block transfer of a page migration
+
     Node *prev;
     Node *next;
+
+    // Neighbours in the FIFO of the target bank
+    Node *bank_prev;
+    Node *bank_next;
+
+    // Neighbours in the block index, keyed by block
+    uint64_t block;
+    bool indexed;
+    Node *hash_prev;
+    Node *hash_next;
+
+    Node *merged; // Reads to the same block served by this read
 }Node;
 
+// A preallocated pool of nodes, requests move between queues without touching malloc/free.
+typedef struct Node_Pool
+{
+    Node *free_list; // Free nodes, linked through their next pointers
+
+    Node **chunks; // Every block of nodes the pool has allocated
+    unsigned num_chunks;
+
+    unsigned capacity; // Total number of nodes owned by the pool
+
+    uint64_t num_allocs; // Number of nodes handed out
+    uint64_t num_mallocs; // Number of malloc calls after the initial preallocation
+}Node_Pool;
+
+// Carve a new block of nodes and thread them onto the free list
+void growNodePool(Node_Pool *pool, unsigned num_nodes)
+{
+    Node *chunk = (Node *)malloc(num_nodes * sizeof(Node));
+
+    pool->chunks = (Node **)realloc(pool->chunks, (pool->num_chunks + 1) * sizeof(Node *));
+    pool->chunks[pool->num_chunks] = chunk;
+    pool->num_chunks = pool->num_chunks + 1;
+
+    for (unsigned i = 0; i < num_nodes; i++)
+    {
+        chunk[i].next = pool->free_list;
+        pool->free_list = &chunk[i];
+    }
+    pool->capacity = pool->capacity + num_nodes;
+}
+
+Node_Pool* initNodePool(unsigned capacity)
+{
+    Node_Pool *pool = (Node_Pool *)malloc(sizeof(Node_Pool));
+
+    pool->free_list = NULL;
+    pool->chunks = NULL;
+    pool->num_chunks = 0;
+    pool->capacity = 0;
+    growNodePool(pool, capacity);
+
+    pool->num_allocs = 0;
+    pool->num_mallocs = 0;
+
+    return pool;
+}
+
+Node *allocNode(Node_Pool *pool)
+{
+    if (pool->free_list == NULL)
+    {
+        // Should never happen when the pool is sized correctly, double it.
+        growNodePool(pool, pool->capacity);
+        pool->num_mallocs = pool->num_mallocs + 1;
+    }
+
+    Node *node = pool->free_list;
+    pool->free_list = node->next;
+    pool->num_allocs = pool->num_allocs + 1;
+
+    return node;
+}
+
+void releaseNode(Node_Pool *pool, Node *node)
+{
+    node->next = pool->free_list;
+    pool->free_list = node;
+}
+
+void freeNodePool(Node_Pool *pool)
+{
+    for (unsigned i = 0; i < pool->num_chunks; i++)
+    {
+        free(pool->chunks[i]);
+    }
+    free(pool->chunks);
+    free(pool);
+}
+
 typedef struct Queue
 {
     Node *first;
     Node *last;
 
     unsigned size; // Current size of the queue
+
+    Node_Pool *pool; // Where the nodes of the queue come from
 }Queue;
 
-Queue* initQueue()
+Queue* initQueue(Node_Pool *pool)
 {
     Queue *q = (Queue *)malloc(sizeof(Queue));
+    q->pool = pool;
 
     q->first = NULL;
     q->last = NULL;
@@ -48,14 +152,26 @@ Queue* initQueue()
     return q;
 }	
 
-// Push a request to the queue
-void pushToQueue(Queue *q, Request *req)
+// Copy the request into the node
+void fillNode(Node *node, Request *req)
 {
-    Node *node = (Node *)malloc(sizeof(Node));
+    node->core_id = req->core_id;
     node->mem_addr = req->memory_address;
     node->req_type = req->req_type;
     node->channel_id = req->channel_id;
     node->bank_id = req->bank_id;
+    node->row_id = req->row_id;
+    node->migration = req->migration;
+
+    node->indexed = false;
+    node->merged = NULL;
+}
+
+// Push a request to the queue, returns the node that holds the request
+Node *pushToQueue(Queue *q, Request *req)
+{
+    Node *node = allocNode(q->pool);
+    fillNode(node, req);
 
     node->prev = NULL;
     node->next = NULL;
@@ -94,92 +210,252 @@ void pushToQueue(Queue *q, Request *req)
     }
     printf("\n");
     */
+
+    return node;
 }
 
-void migrateToQueue(Queue *q, Node *_node)
+// Unlink a node from the queue, the node itself is kept alive
+void removeNode(Queue *q, Node *node)
 {
-    Node *node = (Node *)malloc(sizeof(Node));
-    node->mem_addr = _node->mem_addr;
-    node->req_type = _node->req_type;
-    node->channel_id = _node->channel_id;
-    node->bank_id = _node->bank_id;
-    node->begin_exe = _node->begin_exe;
-    node->end_exe = _node->end_exe;
+    q->size = q->size - 1;
+
+    if (node == q->first && node == q->last)
+    {
+        q->first = NULL;
+        q->last = NULL;
+    }
+    else if (node == q->first && node != q->last)
+    {
+        q->first = node->next; // Node's next node becomes the first node
+        q->first->prev = NULL;
+    }
+    else if (node != q->first && node == q->last)
+    {
+        q->last = node->prev; // Node's previous node becomes the last node
+        q->last->next = NULL;
+    }
+    else
+    {
+        Node *prev = node->prev;
+        Node *next = node->next;
+
+        prev->next = next;
+        next->prev = prev;
+    }
 
     node->prev = NULL;
     node->next = NULL;
+}
 
-    // Check if the queue is empty.
-    if (q->first == NULL && q->last == NULL)
+void deleteNode(Queue *q, Node *node)
+{
+    removeNode(q, node);
+
+    releaseNode(q->pool, node);
+}
+
+// The waiting requests of one bank, in arrival order. The nodes stay linked in
+// the waiting queue as well, this only threads them through bank_prev/bank_next.
+typedef struct Bank_Queue
+{
+    Node *first;
+    Node *last;
+
+    unsigned size;
+}Bank_Queue;
+
+void initBankQueue(Bank_Queue *q)
+{
+    q->first = NULL;
+    q->last = NULL;
+    q->size = 0;
+}
+
+void pushToBankQueue(Bank_Queue *q, Node *node)
+{
+    node->bank_prev = q->last;
+    node->bank_next = NULL;
+
+    if (q->last == NULL)
     {
         q->first = node;
-        q->last = node;
-        q->size = 1;
     }
     else
     {
-        // Now, the new node becomes the last node of the queue.
-        node->prev = q->last;
-        q->last->next = node;
-
-        q->last = node;
-        q->size = q->size + 1;
+        q->last->bank_next = node;
     }
+    q->last = node;
+    q->size = q->size + 1;
+}
 
-    /*
-    // print the queue
-    Node *iter = q->first;
-    while (iter != NULL)
+void removeFromBankQueue(Bank_Queue *q, Node *node)
+{
+    if (node->bank_prev == NULL)
     {
-        printf("(""%"PRIu64, iter->mem_addr);
-        printf(" : ");
-        printf("%d)", iter->bank_id);
+        q->first = node->bank_next;
+    }
+    else
+    {
+        node->bank_prev->bank_next = node->bank_next;
+    }
 
-        iter = iter->next;
-        if (iter != NULL)
-        {
-            printf(" -> ");
-        }
+    if (node->bank_next == NULL)
+    {
+        q->last = node->bank_prev;
     }
-    printf("\n");
-    */
+    else
+    {
+        node->bank_next->bank_prev = node->bank_prev;
+    }
+
+    node->bank_prev = NULL;
+    node->bank_next = NULL;
+    q->size = q->size - 1;
 }
 
-void deleteNode(Queue *q, Node *node)
+// Hash index of the requests by block address, every request of a bucket is chained
+// through hash_prev/hash_next, the youngest first.
+typedef struct Block_Index
 {
-    q->size = q->size - 1;
+    Node **buckets;
+    uint64_t mask; // Number of buckets - 1, a power of two
+}Block_Index;
 
-    if (node == q->first && node == q->last)
+Block_Index *initBlockIndex(unsigned num_buckets)
+{
+    assert((num_buckets & (num_buckets - 1)) == 0);
+
+    Block_Index *index = (Block_Index *)malloc(sizeof(Block_Index));
+    index->buckets = (Node **)calloc(num_buckets, sizeof(Node *));
+    index->mask = num_buckets - 1;
+
+    return index;
+}
+
+void freeBlockIndex(Block_Index *index)
+{
+    free(index->buckets);
+    free(index);
+}
+
+Node **blockBucket(Block_Index *index, uint64_t block)
+{
+    return &(index->buckets[(block * 0x9E3779B97F4A7C15ULL >> 32) & index->mask]);
+}
+
+void insertBlock(Block_Index *index, Node *node, uint64_t block)
+{
+    Node **bucket = blockBucket(index, block);
+
+    node->block = block;
+    node->indexed = true;
+    node->hash_prev = NULL;
+    node->hash_next = *bucket;
+    if (*bucket != NULL)
     {
-        q->first = NULL;
-        q->last = NULL;
+        (*bucket)->hash_prev = node;
+    }
+    *bucket = node;
+}
 
-        free(node);
+void removeBlock(Block_Index *index, Node *node)
+{
+    if (node->hash_prev != NULL)
+    {
+        node->hash_prev->hash_next = node->hash_next;
     }
-    else if (node == q->first && node != q->last)
+    else
     {
-        q->first = node->next; // Node's next node becomes the first node
-        q->first->prev = NULL;
+        *blockBucket(index, node->block) = node->hash_next;
+    }
 
-        free(node);
+    if (node->hash_next != NULL)
+    {
+        node->hash_next->hash_prev = node->hash_prev;
     }
-    else if (node != q->first && node == q->last)
+    node->indexed = false;
+}
+
+// Take every read to the block out of the index, the reads themselves are untouched
+void removeBlockReads(Block_Index *index, uint64_t block)
+{
+    Node *iter = *blockBucket(index, block);
+    while (iter != NULL)
     {
-        q->last = node->prev; // Node's previous node becomes the last node
-        q->last->next = NULL;
+        Node *next = iter->hash_next;
+        if (iter->block == block && iter->req_type == READ)
+        {
+            removeBlock(index, iter);
+        }
+        iter = next;
+    }
+}
 
-        free(node);
+// The youngest indexed request of the given type to the block, NULL if there is none
+Node *findBlock(Block_Index *index, uint64_t block, Request_Type req_type)
+{
+    Node *iter = *blockBucket(index, block);
+    while (iter != NULL && (iter->block != block || iter->req_type != req_type))
+    {
+        iter = iter->hash_next;
     }
-    else
+
+    return iter;
+}
+
+// Requests waiting to be issued, both in arrival order and per target bank
+typedef struct Waiting_Queue
+{
+    Queue *queue; // All the requests, in arrival order
+
+    Bank_Queue *bank_queues; // The requests of each bank, in arrival order
+    uint64_t nonempty_mask; // Bit i is set when bank i has waiting requests
+}Waiting_Queue;
+
+Waiting_Queue *initWaitingQueue(Node_Pool *pool, unsigned num_banks)
+{
+    Waiting_Queue *wq = (Waiting_Queue *)malloc(sizeof(Waiting_Queue));
+
+    wq->queue = initQueue(pool);
+    wq->bank_queues = (Bank_Queue *)malloc(num_banks * sizeof(Bank_Queue));
+    for (int i = 0; i < num_banks; i++)
     {
-        Node *prev = node->prev;
-        Node *next = node->next;
+        initBankQueue(&((wq->bank_queues)[i]));
+    }
+    wq->nonempty_mask = 0;
 
-        prev->next = next;
-        next->prev = prev;
+    return wq;
+}
 
-        free(node);
+// The nodes belong to the pool and are freed with it
+void freeWaitingQueue(Waiting_Queue *wq)
+{
+    free(wq->queue);
+    free(wq->bank_queues);
+    free(wq);
+}
+
+Node *enqueueRequest(Waiting_Queue *wq, Request *req)
+{
+    Node *node = pushToQueue(wq->queue, req);
+
+    pushToBankQueue(&((wq->bank_queues)[node->bank_id]), node);
+    wq->nonempty_mask |= (uint64_t)1 << node->bank_id;
+
+    return node;
+}
+
+// Take a request out of the waiting queue, the node itself is kept alive
+void dequeueRequest(Waiting_Queue *wq, Node *node)
+{
+    Bank_Queue *bank_queue = &((wq->bank_queues)[node->bank_id]);
+    removeFromBankQueue(bank_queue, node);
+    if (bank_queue->size == 0)
+    {
+        wq->nonempty_mask &= ~((uint64_t)1 << node->bank_id);
     }
+
+    removeNode(wq->queue, node);
 }
 
 #endif
@@ -3,6 +3,7 @@
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h> // uint64_t
+#include <stdbool.h>
 
 typedef enum Request_Type{READ, WRITE}Request_Type;
 
@@ -18,6 +19,9 @@ typedef struct Request
     /* Decoding Info */
     int channel_id;
     int bank_id; // Which bank it targets to.
+    uint64_t row_id; // Which row of the bank it targets to.
+
+    bool migration; // Block transfer of a page migration (Hybrid.h), not a core request
 
 }Request;
 
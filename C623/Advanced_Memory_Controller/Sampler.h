@@ -0,0 +1,207 @@
+#ifndef __SAMPLER_HH__
+#define __SAMPLER_HH__
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Request.h"
+
+/*
+ * Time-series sampler. Every SAMPLE_EPOCH memory clocks, each channel closes a sample of
+ * the epoch: the reads and writes that moved data on its bus, the time-averaged depths of
+ * its read and write queues, and the cycles each bank was busy (taken by a request or a
+ * refresh). Samples go into a preallocated ring of SAMPLE_RING_SIZE per channel that is
+ * flushed to a temporary file when full, so a long run costs a few counter increments per
+ * cycle and no allocation.
+ *
+ * At the end, the samples are written as CSV, one row per channel and epoch, so the
+ * phases of the memory traffic can be lined up with the phases of the application.
+ * Epoch boundaries are events of the event-driven loop, the samples are the same with
+ * and without EVENT_DRIVEN.
+ *
+ * Compiled in with the SAMPLER switch of Controller.h, recorded only with --samples.
+ */
+static uint64_t SAMPLE_EPOCH = 10000; // memory clocks per sample
+static unsigned SAMPLE_RING_SIZE = 1024; // samples buffered per channel before a flush
+
+typedef struct Sample
+{
+    uint64_t clk; // Memory clock the epoch ends at
+    uint32_t cycles; // Length of the epoch, the last one may be short
+    uint32_t reads; // Data bursts on the bus
+    uint32_t writes;
+    uint64_t read_occupancy; // Read queue depth summed over the cycles
+    uint64_t write_occupancy;
+}Sample;
+
+typedef struct Sampler
+{
+    unsigned num_banks;
+
+    // The epoch being sampled
+    uint64_t epoch_begin; // First memory clock
+    Sample cur;
+    uint32_t *cur_busy; // Busy cycles per bank
+
+    // The ring, num_banks busy counters per sample
+    Sample *ring;
+    uint32_t *ring_busy;
+    unsigned num_buffered;
+
+    FILE *spill; // Samples flushed from the ring, in order
+    uint64_t num_samples;
+}Sampler;
+
+void resetSample(Sampler *sampler)
+{
+    sampler->cur.clk = 0;
+    sampler->cur.cycles = 0;
+    sampler->cur.reads = 0;
+    sampler->cur.writes = 0;
+    sampler->cur.read_occupancy = 0;
+    sampler->cur.write_occupancy = 0;
+
+    for (unsigned i = 0; i < sampler->num_banks; i++)
+    {
+        sampler->cur_busy[i] = 0;
+    }
+}
+
+// The first epoch begins with memory clock begin_clk
+Sampler *initSampler(unsigned num_banks, uint64_t begin_clk)
+{
+    Sampler *sampler = (Sampler *)malloc(sizeof(Sampler));
+
+    sampler->num_banks = num_banks;
+    sampler->epoch_begin = begin_clk;
+    sampler->cur_busy = (uint32_t *)malloc(num_banks * sizeof(uint32_t));
+    resetSample(sampler);
+
+    sampler->ring = (Sample *)malloc(SAMPLE_RING_SIZE * sizeof(Sample));
+    sampler->ring_busy = (uint32_t *)malloc(SAMPLE_RING_SIZE * num_banks * sizeof(uint32_t));
+    sampler->num_buffered = 0;
+
+    sampler->spill = NULL;
+    sampler->num_samples = 0;
+
+    return sampler;
+}
+
+void freeSampler(Sampler *sampler)
+{
+    if (sampler->spill != NULL)
+    {
+        fclose(sampler->spill);
+    }
+    free(sampler->cur_busy);
+    free(sampler->ring);
+    free(sampler->ring_busy);
+    free(sampler);
+}
+
+void flushSamples(Sampler *sampler)
+{
+    if (sampler->spill == NULL)
+    {
+        sampler->spill = tmpfile();
+        assert(sampler->spill != NULL);
+    }
+
+    // One record per sample, the sample then its busy counters
+    for (unsigned i = 0; i < sampler->num_buffered; i++)
+    {
+        fwrite(&(sampler->ring[i]), sizeof(Sample), 1, sampler->spill);
+        fwrite(&(sampler->ring_busy[i * sampler->num_banks]), sizeof(uint32_t), sampler->num_banks,
+               sampler->spill);
+    }
+    sampler->num_buffered = 0;
+}
+
+// A request has moved its data on the bus
+void sampleTransfer(Sampler *sampler, Request_Type req_type)
+{
+    if (req_type == READ)
+    {
+        ++sampler->cur.reads;
+    }
+    else
+    {
+        ++sampler->cur.writes;
+    }
+}
+
+// Close the epoch with memory clock end_clk, a new one begins right after
+void closeSample(Sampler *sampler, uint64_t end_clk)
+{
+    if (sampler->num_buffered == SAMPLE_RING_SIZE)
+    {
+        flushSamples(sampler);
+    }
+
+    sampler->cur.clk = end_clk;
+    sampler->cur.cycles = end_clk + 1 - sampler->epoch_begin;
+    sampler->ring[sampler->num_buffered] = sampler->cur;
+    for (unsigned i = 0; i < sampler->num_banks; i++)
+    {
+        sampler->ring_busy[sampler->num_buffered * sampler->num_banks + i] = sampler->cur_busy[i];
+    }
+    ++sampler->num_buffered;
+    ++sampler->num_samples;
+
+    sampler->epoch_begin = end_clk + 1;
+    resetSample(sampler);
+}
+
+void writeSampleCSV(FILE *fd, int channel_id, Sample *sample, uint32_t *busy, unsigned num_banks,
+                    double tck, unsigned block_size)
+{
+    uint64_t transfers = (uint64_t)sample->reads + sample->writes;
+    double time = sample->cycles * tck; // ns
+
+    fprintf(fd, "%d,%"PRIu64",%u,%u,%u,%f,%f,%f,%f", channel_id, sample->clk, sample->cycles,
+            sample->reads, sample->writes, transfers ? (double)sample->reads / transfers : 0.0,
+            time ? transfers * block_size / time : 0.0,
+            sample->cycles ? (double)sample->read_occupancy / sample->cycles : 0.0,
+            sample->cycles ? (double)sample->write_occupancy / sample->cycles : 0.0);
+    for (unsigned i = 0; i < num_banks; i++)
+    {
+        fprintf(fd, ",%f", sample->cycles ? (double)busy[i] / sample->cycles : 0.0);
+    }
+    fprintf(fd, "\n");
+}
+
+// The rows of one channel, in order. tck: ns per memory clock, for the bandwidth. The
+// samples are consumed.
+void writeChannelSamples(FILE *fd, Sampler *sampler, int channel_id, double tck, unsigned block_size)
+{
+    if (sampler->spill != NULL)
+    {
+        // Flush the rest as well, then read everything back, a record at a time.
+        flushSamples(sampler);
+        rewind(sampler->spill);
+        while (fread(sampler->ring, sizeof(Sample), 1, sampler->spill) == 1)
+        {
+            size_t num_busy = fread(sampler->ring_busy, sizeof(uint32_t), sampler->num_banks,
+                                    sampler->spill);
+            assert(num_busy == sampler->num_banks);
+            writeSampleCSV(fd, channel_id, sampler->ring, sampler->ring_busy, sampler->num_banks, tck,
+                           block_size);
+        }
+        fclose(sampler->spill);
+        sampler->spill = NULL;
+
+        return;
+    }
+
+    for (unsigned i = 0; i < sampler->num_buffered; i++)
+    {
+        writeSampleCSV(fd, channel_id, &(sampler->ring[i]),
+                       &(sampler->ring_busy[i * sampler->num_banks]), sampler->num_banks, tck,
+                       block_size);
+    }
+    sampler->num_buffered = 0;
+}
+
+#endif
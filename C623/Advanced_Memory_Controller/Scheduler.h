@@ -0,0 +1,396 @@
+#ifndef __SCHEDULER_HH__
+#define __SCHEDULER_HH__
+
+#include "Controller.h"
+
+/*
+ * Request schedulers. Every scheduler picks, among the waiting requests whose target
+ * bank is free and whose first command can go out this cycle, the one it likes best.
+ * FCFS and FR-FCFS ignore who sent the request, the fairness-aware ones (PAR-BS, ATLAS,
+ * BLISS) rank the requests by their core_id as well. The scheduler is picked with the
+ * #define in Controller.h.
+ *
+ * All the scheduler state is kept per channel.
+ */
+
+// PAR-BS, parallelism-aware batch scheduling
+static unsigned PARBS_MARKING_CAP = 5; // requests marked per core per bank in a batch
+
+// ATLAS, least attained service first
+static unsigned ATLAS_QUANTUM = 10000; // memory clocks per ranking quantum
+static double ATLAS_ALPHA = 0.875; // weight of the past quanta in the attained service
+static unsigned ATLAS_STARVATION = 10000; // requests older than this go first
+
+// BLISS, blacklist the cores that get many requests served in a row
+#ifdef BLISS
+static unsigned BLISS_THRESHOLD = 4; // requests in a row before a core is blacklisted
+#endif
+static unsigned BLISS_CLEARING = 10000; // memory clocks between blacklist clearings
+
+#ifdef FCFS
+static const char *scheduler_name = "FCFS";
+#endif
+#ifdef FR_FCFS
+static const char *scheduler_name = "FR-FCFS";
+#endif
+#ifdef PAR_BS
+static const char *scheduler_name = "PAR-BS";
+#endif
+#ifdef ATLAS
+static const char *scheduler_name = "ATLAS";
+#endif
+#ifdef BLISS
+static const char *scheduler_name = "BLISS";
+#endif
+
+bool isRowHit(Controller *controller, Node *node)
+{
+    return rowHit(&((controller->bank_status)[node->bank_id]), node->row_id);
+}
+
+// Implementation One - FCFS: only the oldest request can be issued.
+Node *scheduleFCFS(Controller *controller, Waiting_Queue *wq)
+{
+    Node *first = wq->queue->first;
+    if ((controller->free_mask & ((uint64_t)1 << first->bank_id)) &&
+        canIssue(controller, first))
+    {
+        return first;
+    }
+
+    return NULL;
+}
+
+// Implementation Two - FR-FCFS: the oldest request that hits an open row of a free bank,
+// otherwise the oldest request to a free bank.
+Node *scheduleFRFCFS(Controller *controller, Waiting_Queue *wq)
+{
+    Node *oldest_hit = NULL;
+
+    uint64_t ready = readyBanks(controller, wq);
+    while (ready)
+    {
+        int bank_id = __builtin_ctzll(ready);
+        ready &= ready - 1;
+
+        Bank *bank = &((controller->bank_status)[bank_id]);
+        if (bank->num_open == 0)
+        {
+            continue;
+        }
+
+        // The first hit in a bank's FIFO is the oldest hit of that bank.
+        Node *iter = (wq->bank_queues)[bank_id].first;
+        while (iter != NULL && !rowHit(bank, iter->row_id))
+        {
+            iter = iter->bank_next;
+        }
+
+        if (iter != NULL && canIssue(controller, iter) &&
+            (oldest_hit == NULL || iter->seq < oldest_hit->seq))
+        {
+            oldest_hit = iter;
+        }
+    }
+
+    if (oldest_hit != NULL)
+    {
+        return oldest_hit;
+    }
+
+    Node *oldest = oldestReadyRequest(controller, wq);
+    if (oldest != NULL && canIssue(controller, oldest))
+    {
+        return oldest;
+    }
+
+    return NULL;
+}
+
+/* PAR-BS */
+// Mark up to PARBS_MARKING_CAP of the oldest requests of each core in each bank, then
+// rank the cores shortest job first: the fewer marked requests a core has in its most
+// loaded bank (and then in total), the higher its rank.
+void formBatch(Controller *controller, Waiting_Queue *wq)
+{
+    unsigned max_load[64]; // The core masks are 64-bit wide
+    unsigned total_load[64];
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        max_load[i] = 0;
+        total_load[i] = 0;
+    }
+
+    uint64_t nonempty = wq->nonempty_mask;
+    while (nonempty)
+    {
+        int bank_id = __builtin_ctzll(nonempty);
+        nonempty &= nonempty - 1;
+
+        unsigned bank_load[64];
+        for (int i = 0; i < NUM_OF_CORES; i++)
+        {
+            bank_load[i] = 0;
+        }
+
+        Node *iter = (wq->bank_queues)[bank_id].first;
+        while (iter != NULL)
+        {
+            if (bank_load[iter->core_id] < PARBS_MARKING_CAP)
+            {
+                iter->marked = true;
+                ++bank_load[iter->core_id];
+                ++total_load[iter->core_id];
+                ++controller->num_marked;
+            }
+            iter = iter->bank_next;
+        }
+
+        for (int i = 0; i < NUM_OF_CORES; i++)
+        {
+            if (bank_load[i] > max_load[i])
+            {
+                max_load[i] = bank_load[i];
+            }
+        }
+    }
+
+    for (int i = 0; i < NUM_OF_CORES; i++)
+    {
+        unsigned rank = 0;
+        for (int j = 0; j < NUM_OF_CORES; j++)
+        {
+            if (max_load[j] < max_load[i] ||
+                (max_load[j] == max_load[i] && total_load[j] < total_load[i]) ||
+                (max_load[j] == max_load[i] && total_load[j] == total_load[i] && j < i))
+            {
+                ++rank;
+            }
+        }
+        controller->core_rank[i] = rank;
+    }
+
+    ++controller->num_batches;
+}
+
+// Marked first, then row hits, then higher ranked cores, then older requests
+bool higherPriorityPARBS(Controller *controller, Node *a, Node *b)
+{
+    if (a->marked != b->marked)
+    {
+        return a->marked;
+    }
+
+    bool a_hit = isRowHit(controller, a);
+    if (a_hit != isRowHit(controller, b))
+    {
+        return a_hit;
+    }
+
+    if (a->core_id != b->core_id &&
+        controller->core_rank[a->core_id] != controller->core_rank[b->core_id])
+    {
+        return controller->core_rank[a->core_id] < controller->core_rank[b->core_id];
+    }
+
+    return a->seq < b->seq;
+}
+
+/* ATLAS */
+// At the end of each quantum, fold the service the cores attained into their history
+// and rank the cores by it, the least attained service gets the highest rank.
+void updateQuantum(Controller *controller)
+{
+    while (controller->cur_clk >= controller->next_quantum)
+    {
+        for (int i = 0; i < NUM_OF_CORES; i++)
+        {
+            controller->core_total_service[i] =
+                ATLAS_ALPHA * controller->core_total_service[i] +
+                (1 - ATLAS_ALPHA) * controller->core_service[i];
+            controller->core_service[i] = 0;
+        }
+
+        for (int i = 0; i < NUM_OF_CORES; i++)
+        {
+            unsigned rank = 0;
+            for (int j = 0; j < NUM_OF_CORES; j++)
+            {
+                if (controller->core_total_service[j] < controller->core_total_service[i] ||
+                    (controller->core_total_service[j] == controller->core_total_service[i] &&
+                     j < i))
+                {
+                    ++rank;
+                }
+            }
+            controller->core_rank[i] = rank;
+        }
+
+        controller->next_quantum += ATLAS_QUANTUM;
+    }
+}
+
+// Starving requests first, then higher ranked cores, then row hits, then older requests
+bool higherPriorityATLAS(Controller *controller, Node *a, Node *b)
+{
+    bool a_starving = controller->cur_clk - a->arrival >= ATLAS_STARVATION;
+    bool b_starving = controller->cur_clk - b->arrival >= ATLAS_STARVATION;
+    if (a_starving != b_starving)
+    {
+        return a_starving;
+    }
+
+    if (a->core_id != b->core_id &&
+        controller->core_rank[a->core_id] != controller->core_rank[b->core_id])
+    {
+        return controller->core_rank[a->core_id] < controller->core_rank[b->core_id];
+    }
+
+    bool a_hit = isRowHit(controller, a);
+    if (a_hit != isRowHit(controller, b))
+    {
+        return a_hit;
+    }
+
+    return a->seq < b->seq;
+}
+
+/* BLISS */
+void clearBlacklist(Controller *controller)
+{
+    while (controller->cur_clk >= controller->next_clearing)
+    {
+        controller->blacklist = 0;
+        controller->next_clearing += BLISS_CLEARING;
+    }
+}
+
+// Cores not blacklisted first, then row hits, then older requests
+bool higherPriorityBLISS(Controller *controller, Node *a, Node *b)
+{
+    bool a_listed = (controller->blacklist >> a->core_id) & 1;
+    bool b_listed = (controller->blacklist >> b->core_id) & 1;
+    if (a_listed != b_listed)
+    {
+        return b_listed;
+    }
+
+    bool a_hit = isRowHit(controller, a);
+    if (a_hit != isRowHit(controller, b))
+    {
+        return a_hit;
+    }
+
+    return a->seq < b->seq;
+}
+
+// The best request of the free banks that can be issued this cycle, according to
+// the priority order higherPriority
+Node *schedulePrioritized(Controller *controller, Waiting_Queue *wq,
+                          bool (*higherPriority)(Controller *, Node *, Node *))
+{
+    Node *best = NULL;
+
+    uint64_t ready = readyBanks(controller, wq);
+    while (ready)
+    {
+        int bank_id = __builtin_ctzll(ready);
+        ready &= ready - 1;
+
+        Node *iter = (wq->bank_queues)[bank_id].first;
+        while (iter != NULL)
+        {
+            if ((best == NULL || higherPriority(controller, iter, best)) &&
+                canIssue(controller, iter))
+            {
+                best = iter;
+            }
+            iter = iter->bank_next;
+        }
+    }
+
+    return best;
+}
+
+/* Scheduler interface, used by tick() */
+// Called at the start of every tick, before any request is picked
+void updateScheduler(Controller *controller)
+{
+    #ifdef ATLAS
+    updateQuantum(controller);
+    #endif
+
+    #ifdef BLISS
+    clearBlacklist(controller);
+    #endif
+}
+
+// Pick the request to issue this cycle from the queue, NULL if there is none
+Node *schedule(Controller *controller, Waiting_Queue *wq)
+{
+    #ifdef FCFS
+    return scheduleFCFS(controller, wq);
+    #endif
+
+    #ifdef FR_FCFS
+    return scheduleFRFCFS(controller, wq);
+    #endif
+
+    #ifdef PAR_BS
+    // Writes are drained in batches of their own (watermarks), only reads are batched.
+    if (wq != controller->read_queue)
+    {
+        return scheduleFRFCFS(controller, wq);
+    }
+
+    if (controller->num_marked == 0)
+    {
+        formBatch(controller, wq);
+    }
+    return schedulePrioritized(controller, wq, higherPriorityPARBS);
+    #endif
+
+    #ifdef ATLAS
+    return schedulePrioritized(controller, wq, higherPriorityATLAS);
+    #endif
+
+    #ifdef BLISS
+    return schedulePrioritized(controller, wq, higherPriorityBLISS);
+    #endif
+}
+
+// Called once the commands of the request are issued
+void requestScheduled(Controller *controller, Node *node)
+{
+    #ifdef PAR_BS
+    if (node->marked)
+    {
+        --controller->num_marked;
+    }
+    #endif
+
+    #ifdef ATLAS
+    controller->core_service[node->core_id] += node->end_exe - node->begin_exe;
+    #endif
+
+    #ifdef BLISS
+    if (node->core_id == controller->last_core)
+    {
+        ++controller->streak;
+    }
+    else
+    {
+        controller->last_core = node->core_id;
+        controller->streak = 1;
+    }
+
+    if (controller->streak >= BLISS_THRESHOLD &&
+        !((controller->blacklist >> node->core_id) & 1))
+    {
+        controller->blacklist |= (uint64_t)1 << node->core_id;
+        ++controller->blacklistings;
+    }
+    #endif
+}
+
+#endif
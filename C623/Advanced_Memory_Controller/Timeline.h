@@ -0,0 +1,227 @@
+#ifndef __TIMELINE_HH__
+#define __TIMELINE_HH__
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Request.h"
+
+/*
+ * Timeline recorder. Every channel records, in binary, the busy interval of a bank for
+ * each request (issue to completion, tagged row hit/miss/conflict) and each refresh,
+ * the data burst of each request on the channel bus and the depths of the read and
+ * write queues whenever they change. Events collect in a fixed-size buffer per channel
+ * that is spilled to a temporary file when full, so the recording stays cheap however
+ * long the run is.
+ *
+ * At the end, the events are converted to a Chrome trace-event JSON file (open it in
+ * ui.perfetto.dev or chrome://tracing): one process per channel, one track per bank
+ * plus one for the data bus, and a counter track of the queue depths. Timestamps are
+ * memory clocks, shown as microseconds.
+ *
+ * Compiled in with the TIMELINE switch of Controller.h, recorded only with --timeline.
+ */
+static unsigned TIMELINE_BUFFER_EVENTS = 65536; // events buffered per channel before a spill
+
+typedef enum Timeline_Kind{TL_ROW_HIT, TL_ROW_MISS, TL_ROW_CONFLICT, TL_TRANSFER, TL_QUEUES, TL_REFRESH}Timeline_Kind;
+
+static const char *timeline_kind_names[] = {"Row Hit", "Row Miss", "Row Conflict", "Burst", "Queue Depth", "Refresh"};
+
+typedef struct Timeline_Event
+{
+    uint64_t begin; // Memory clock
+    uint64_t row_id; // The write queue depth for TL_QUEUES
+    uint32_t duration;
+    uint32_t core_id; // The read queue depth for TL_QUEUES
+    uint16_t kind; // Timeline_Kind
+    uint16_t bank_id;
+    uint16_t req_type;
+}Timeline_Event;
+
+typedef struct Timeline
+{
+    Timeline_Event *events;
+    unsigned num_buffered;
+
+    FILE *spill; // Events that overflowed the buffer, in recording order
+    uint64_t num_events;
+}Timeline;
+
+Timeline *initTimeline()
+{
+    Timeline *timeline = (Timeline *)malloc(sizeof(Timeline));
+
+    timeline->events = (Timeline_Event *)malloc(TIMELINE_BUFFER_EVENTS * sizeof(Timeline_Event));
+    timeline->num_buffered = 0;
+    timeline->spill = NULL;
+    timeline->num_events = 0;
+
+    return timeline;
+}
+
+void freeTimeline(Timeline *timeline)
+{
+    if (timeline->spill != NULL)
+    {
+        fclose(timeline->spill);
+    }
+    free(timeline->events);
+    free(timeline);
+}
+
+void spillTimeline(Timeline *timeline)
+{
+    if (timeline->spill == NULL)
+    {
+        timeline->spill = tmpfile();
+        assert(timeline->spill != NULL);
+    }
+
+    fwrite(timeline->events, sizeof(Timeline_Event), timeline->num_buffered, timeline->spill);
+    timeline->num_buffered = 0;
+}
+
+Timeline_Event *newTimelineEvent(Timeline *timeline, Timeline_Kind kind, uint64_t begin)
+{
+    if (timeline->num_buffered == TIMELINE_BUFFER_EVENTS)
+    {
+        spillTimeline(timeline);
+    }
+
+    Timeline_Event *event = &(timeline->events[timeline->num_buffered++]);
+    event->kind = kind;
+    event->begin = begin;
+    ++timeline->num_events;
+
+    return event;
+}
+
+// The bank is busy with the request from begin to end, its data is on the bus for burst clocks
+void recordRequestTimeline(Timeline *timeline, Timeline_Kind row_outcome, Request_Type req_type,
+                           int core_id, int bank_id, uint64_t row_id,
+                           uint64_t begin, uint64_t end, unsigned burst)
+{
+    Timeline_Event *event = newTimelineEvent(timeline, row_outcome, begin);
+    event->duration = end - begin;
+    event->row_id = row_id;
+    event->core_id = core_id;
+    event->bank_id = bank_id;
+    event->req_type = req_type;
+
+    event = newTimelineEvent(timeline, TL_TRANSFER, end - burst);
+    event->duration = burst;
+    event->row_id = row_id;
+    event->core_id = core_id;
+    event->bank_id = bank_id;
+    event->req_type = req_type;
+}
+
+void recordQueueTimeline(Timeline *timeline, uint64_t clk, unsigned num_reads, unsigned num_writes)
+{
+    Timeline_Event *event = newTimelineEvent(timeline, TL_QUEUES, clk);
+    event->duration = 0;
+    event->row_id = num_writes;
+    event->core_id = num_reads;
+    event->bank_id = 0;
+    event->req_type = READ;
+}
+
+// The bank is kept from requests by a refresh from begin to end
+void recordRefreshTimeline(Timeline *timeline, int bank_id, uint64_t begin, uint64_t end)
+{
+    Timeline_Event *event = newTimelineEvent(timeline, TL_REFRESH, begin);
+    event->duration = end - begin;
+    event->row_id = 0;
+    event->core_id = 0;
+    event->bank_id = bank_id;
+    event->req_type = READ;
+}
+
+void writeTimelineEvent(FILE *fd, Timeline_Event *event, int channel_id, unsigned bus_track)
+{
+    const char *type = (event->req_type == READ) ? "RD" : "WR";
+    if (event->kind == TL_QUEUES)
+    {
+        fprintf(fd, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"ts\":%"PRIu64","
+                "\"args\":{\"read\":%u,\"write\":%"PRIu64"}}",
+                timeline_kind_names[event->kind], channel_id, event->begin,
+                event->core_id, event->row_id);
+    }
+    else if (event->kind == TL_REFRESH)
+    {
+        fprintf(fd, ",\n{\"name\":\"%s\",\"cat\":\"refresh\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                "\"ts\":%"PRIu64",\"dur\":%u}",
+                timeline_kind_names[event->kind], channel_id, event->bank_id, event->begin,
+                event->duration);
+    }
+    else if (event->kind == TL_TRANSFER)
+    {
+        fprintf(fd, ",\n{\"name\":\"%s %s\",\"cat\":\"bus\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                "\"ts\":%"PRIu64",\"dur\":%u,\"args\":{\"core\":%u,\"bank\":%u}}",
+                type, timeline_kind_names[event->kind], channel_id, bus_track, event->begin,
+                event->duration, event->core_id, event->bank_id);
+    }
+    else
+    {
+        fprintf(fd, ",\n{\"name\":\"%s %s\",\"cat\":\"bank\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+                "\"ts\":%"PRIu64",\"dur\":%u,\"args\":{\"core\":%u,\"row\":%"PRIu64"}}",
+                type, timeline_kind_names[event->kind], channel_id, event->bank_id, event->begin,
+                event->duration, event->core_id, event->row_id);
+    }
+}
+
+// The JSON events of one channel, in recording order. Tracks 0 to num_banks - 1 are the
+// banks, track num_banks the data bus. The events are consumed.
+void writeChannelTimeline(FILE *fd, Timeline *timeline, int channel_id, unsigned num_banks)
+{
+    // Channel 0 opens the event list, no separator before it
+    fprintf(fd, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"Channel %d\"}}", channel_id ? ",\n" : "", channel_id, channel_id);
+    fprintf(fd, ",\n{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"sort_index\":%d}}", channel_id, channel_id);
+    for (unsigned i = 0; i <= num_banks; i++)
+    {
+        char track[32];
+        if (i < num_banks)
+        {
+            sprintf(track, "Bank %u", i);
+        }
+        else
+        {
+            sprintf(track, "Data Bus");
+        }
+        fprintf(fd, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s\"}}", channel_id, i, track);
+        fprintf(fd, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+                "\"args\":{\"sort_index\":%u}}", channel_id, i, i);
+    }
+
+    if (timeline->spill != NULL)
+    {
+        // Spill the rest as well, then read everything back through the buffer.
+        spillTimeline(timeline);
+        rewind(timeline->spill);
+        size_t num_read;
+        while ((num_read = fread(timeline->events, sizeof(Timeline_Event), TIMELINE_BUFFER_EVENTS,
+                                 timeline->spill)) > 0)
+        {
+            for (size_t i = 0; i < num_read; i++)
+            {
+                writeTimelineEvent(fd, &(timeline->events[i]), channel_id, num_banks);
+            }
+        }
+        fclose(timeline->spill);
+        timeline->spill = NULL;
+
+        return;
+    }
+
+    for (unsigned i = 0; i < timeline->num_buffered; i++)
+    {
+        writeTimelineEvent(fd, &(timeline->events[i]), channel_id, num_banks);
+    }
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef __TIMING_HH__
+#define __TIMING_HH__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Timing parameters of a memory part, in memory clocks
+typedef struct Timing
+{
+    const char *name;
+
+    unsigned nclks_rcd; // ACT to RD/WR of the same bank
+    unsigned nclks_rp; // PRE to ACT of the same bank
+    unsigned nclks_ras; // ACT to PRE of the same bank
+    unsigned nclks_cl; // RD to read data
+    unsigned nclks_cwl; // WR to write data
+    unsigned nclks_bl; // Data burst on the channel bus
+    unsigned nclks_ccd; // RD to RD, WR to WR (tCCD_S, different bank groups)
+    unsigned nclks_rrd; // ACT to ACT of different banks (tRRD_S)
+    unsigned nclks_faw; // Window that holds at most four ACTs of a rank
+    unsigned nclks_wtr; // End of write data to RD (write-to-read turnaround, tWTR_S)
+    unsigned nclks_rtw; // RD to WR (read-to-write turnaround)
+    unsigned nclks_rtp; // RD to PRE
+    unsigned nclks_wr; // End of write data to PRE (write recovery)
+    unsigned nclks_refi; // Average interval between refreshes, 0 for a part without refresh
+    unsigned nclks_rfc; // All-bank refresh to the next ACT
+    unsigned nclks_rfc_pb; // Per-bank refresh to the next ACT of the bank
+    unsigned nclks_ccd_l; // RD to RD, WR to WR within a bank group (tCCD_L)
+    unsigned nclks_rrd_l; // ACT to ACT within a bank group (tRRD_L)
+    unsigned nclks_wtr_l; // End of write data to RD within a bank group (tWTR_L)
+    unsigned nclks_rtrs; // Bus idle between the data bursts of two ranks (rank switch)
+}Timing;
+
+static Timing timing_presets[] =
+{
+    // name,        rcd, rp, ras, cl, cwl, bl, ccd, rrd, faw, wtr, rtw, rtp, wr,  refi, rfc, rfc_pb,
+    //              ccd_l, rrd_l, wtr_l, rtrs
+    // DDR4 8Gb: tREFI 7.8 us, tRFC 350 ns. DDR4 has no per-bank refresh, tRFCpb is the
+    // 140 ns of LPDDR4 8Gb.
+    {"DDR4-2400",   17,  17, 39,  17, 12,  4,  4,   4,   26,  3,   11,  9,   18,  9360, 420, 168,
+                    6,     6,     9,     2},
+    // DDR5 16Gb: tREFI 3.9 us, tRFC1 295 ns, tRFCsb 130 ns
+    {"DDR5-4800",   39,  39, 77,  40, 38,  8,  8,   8,   32,  6,   12,  18,  72,  9360, 708, 312,
+                    12,    12,    24,    2},
+    // PCM behind a DDR4-like interface, no refresh. A row miss read takes 57 clocks and a
+    // row miss write 52 to the end of its data. The array write (tWR = 146) then holds
+    // the row: the next PRE, and the next row of the bank, wait for it.
+    {"PCM",         36,  17, 36,  17, 12,  4,  4,   4,   26,  3,   11,  9,   146, 0,    0,   0,
+                    6,     6,     9,     2},
+};
+
+static Timing timing; // The timings the memory system runs with
+static Timing pcm_timing; // The timings of the PCM channels of a hybrid memory system
+
+bool findTimingPreset(const char *name, Timing *dst)
+{
+    unsigned num_presets = sizeof(timing_presets) / sizeof(Timing);
+    for (unsigned i = 0; i < num_presets; i++)
+    {
+        if (strcmp(timing_presets[i].name, name) == 0)
+        {
+            *dst = timing_presets[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool loadTimingPreset(const char *name)
+{
+    return findTimingPreset(name, &timing);
+}
+
+void printTimingPresets()
+{
+    unsigned num_presets = sizeof(timing_presets) / sizeof(Timing);
+    for (unsigned i = 0; i < num_presets; i++)
+    {
+        printf("%s%s", i ? "|" : "", timing_presets[i].name);
+    }
+}
+
+#endif
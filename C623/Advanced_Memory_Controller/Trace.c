@@ -6,33 +6,234 @@ TraceParser *initTraceParser(const char * mem_file)
 
     trace_parser->fd = fopen(mem_file, "r");
     trace_parser->cur_req = (Request *)malloc(sizeof(Request));
+    trace_parser->core_filter = -1;
+    trace_parser->num_reqs = 0;
+    trace_parser->timestamp = 0;
+    trace_parser->mix = NULL;
 
     return trace_parser;
 }
 
+// Heap key of the next request of source i
+uint64_t mixKey(Trace_Mix *mix, unsigned i)
+{
+    TraceParser *source = mix->sources[i];
+    if (mix->policy == MIX_TIMESTAMP)
+    {
+        return source->timestamp;
+    }
+
+    uint64_t position = source->num_reqs - 1; // Position of the request in its trace
+    return (mix->policy == MIX_RATE) ? position * mix->strides[i] : position;
+}
+
+// Whether source a goes before source b
+bool mixBefore(Trace_Mix *mix, unsigned a, unsigned b)
+{
+    return mix->keys[a] < mix->keys[b] || (mix->keys[a] == mix->keys[b] && a < b);
+}
+
+void siftDownMix(Trace_Mix *mix, unsigned i)
+{
+    unsigned source = mix->heap[i];
+    while (2 * i + 1 < mix->heap_size)
+    {
+        unsigned child = 2 * i + 1;
+        if (child + 1 < mix->heap_size && mixBefore(mix, mix->heap[child + 1], mix->heap[child]))
+        {
+            child = child + 1;
+        }
+
+        if (!mixBefore(mix, mix->heap[child], source))
+        {
+            break;
+        }
+        mix->heap[i] = mix->heap[child];
+        i = child;
+    }
+    mix->heap[i] = source;
+}
+
+// Merge single-program traces, trace i sends as core i. NULL if a trace cannot be opened.
+// weights: per trace, only for MIX_RATE, NULL for all ones.
+TraceParser *initTraceMix(const char **mem_files, unsigned num_files, Mix_Policy policy,
+                          const unsigned *weights)
+{
+    Trace_Mix *mix = (Trace_Mix *)malloc(sizeof(Trace_Mix));
+    mix->sources = (TraceParser **)malloc(num_files * sizeof(TraceParser *));
+    mix->num_sources = num_files;
+    mix->policy = policy;
+    mix->keys = (uint64_t *)malloc(num_files * sizeof(uint64_t));
+    mix->strides = (uint64_t *)malloc(num_files * sizeof(uint64_t));
+    mix->heap = (unsigned *)malloc(num_files * sizeof(unsigned));
+    mix->heap_size = 0;
+
+    TraceParser *trace_parser = (TraceParser *)malloc(sizeof(TraceParser));
+    trace_parser->fd = NULL;
+    trace_parser->cur_req = (Request *)malloc(sizeof(Request));
+    trace_parser->core_filter = -1;
+    trace_parser->num_reqs = 0;
+    trace_parser->timestamp = 0;
+    trace_parser->mix = mix;
+
+    unsigned i;
+    for (i = 0; i < num_files; i++)
+    {
+        mix->sources[i] = NULL;
+    }
+
+    for (i = 0; i < num_files; i++)
+    {
+        TraceParser *source = initTraceParser(mem_files[i]);
+        if (source->fd == NULL)
+        {
+            closeTraceParser(source);
+            closeTraceParser(trace_parser);
+            return NULL;
+        }
+
+        mix->strides[i] = MIX_RATE_STRIDE / ((weights != NULL) ? weights[i] : 1);
+
+        // Every source holds its next request, an empty trace is released right away.
+        if (getRequest(source))
+        {
+            mix->sources[i] = source;
+            mix->keys[i] = mixKey(mix, i);
+            mix->heap[mix->heap_size++] = i;
+        }
+    }
+
+    for (i = mix->heap_size / 2; i-- > 0;)
+    {
+        siftDownMix(mix, i);
+    }
+
+    return trace_parser;
+}
+
+void closeTraceParser(TraceParser *mem_trace)
+{
+    if (mem_trace->fd != NULL)
+    {
+        fclose(mem_trace->fd);
+    }
+
+    Trace_Mix *mix = mem_trace->mix;
+    if (mix != NULL)
+    {
+        for (unsigned i = 0; i < mix->num_sources; i++)
+        {
+            if (mix->sources[i] != NULL)
+            {
+                closeTraceParser(mix->sources[i]);
+            }
+        }
+        free(mix->sources);
+        free(mix->keys);
+        free(mix->strides);
+        free(mix->heap);
+        free(mix);
+    }
+
+    free(mem_trace->cur_req);
+    free(mem_trace);
+}
+
+// The next request of the mix, from the source on top of the heap
+bool getMixedRequest(TraceParser *mem_trace)
+{
+    Trace_Mix *mix = mem_trace->mix;
+    while (mix->heap_size)
+    {
+        unsigned i = mix->heap[0];
+        TraceParser *source = mix->sources[i];
+
+        // With a core filter, the other sources are dropped without being read.
+        bool wanted = (mem_trace->core_filter < 0 || mem_trace->core_filter == i);
+        if (wanted)
+        {
+            *(mem_trace->cur_req) = *(source->cur_req);
+            mem_trace->cur_req->core_id = i;
+            mem_trace->timestamp = source->timestamp;
+        }
+
+        // Move the source on to its next request
+        if (wanted && getRequest(source))
+        {
+            mix->keys[i] = mixKey(mix, i);
+        }
+        else
+        {
+            if (!wanted)
+            {
+                closeTraceParser(source);
+            }
+            mix->sources[i] = NULL; // getRequest() has released an exhausted source
+            mix->heap[0] = mix->heap[--mix->heap_size];
+        }
+
+        if (mix->heap_size)
+        {
+            siftDownMix(mix, 0);
+        }
+
+        if (wanted)
+        {
+            ++mem_trace->num_reqs;
+            return true;
+        }
+    }
+
+    closeTraceParser(mem_trace);
+    return false;
+}
+
 bool getRequest(TraceParser *mem_trace)
 {
+    if (mem_trace->mix != NULL)
+    {
+        return getMixedRequest(mem_trace);
+    }
+
     char *line = NULL;
     size_t len = 0;
     ssize_t read;
 
-    if ((read = getline(&line, &len, mem_trace->fd)) != -1)
+    while ((read = getline(&line, &len, mem_trace->fd)) != -1)
     {
 	char delim[] = " \n";
 
+        // "[core] addr R|W [timestamp]"
+        char *tokens[4];
+        int num_tokens = 0;
 	char *ptr = strtok(line, delim);
-        int core_id = atoi(ptr);
+        while (ptr != NULL && num_tokens < 4)
+        {
+            tokens[num_tokens++] = ptr;
+            ptr = strtok(NULL, delim);
+        }
+        if (num_tokens < 2)
+        {
+            continue;
+        }
 
-        ptr = strtok(NULL, delim);
-        uint64_t mem_addr = convToUint64(ptr);
+        int type_idx = (num_tokens >= 3 &&
+                        (strcmp(tokens[2], "R") == 0 || strcmp(tokens[2], "W") == 0)) ? 2 : 1;
+
+        int core_id = (type_idx == 2) ? atoi(tokens[0]) : 0;
+        if (mem_trace->core_filter >= 0 && core_id != mem_trace->core_filter)
+        {
+            continue;
+        }
+
+        uint64_t mem_addr = convToUint64(tokens[type_idx - 1]);
 
-        ptr = strtok(NULL, delim);
         Request_Type req_type;
-        if (strcmp(ptr, "R") == 0)
+        if (strcmp(tokens[type_idx], "R") == 0)
         {
             req_type = READ;
         }
-        else if (strcmp(ptr, "W") == 0)
+        else if (strcmp(tokens[type_idx], "W") == 0)
         {
             req_type = WRITE;
         }
@@ -40,6 +241,11 @@ bool getRequest(TraceParser *mem_trace)
         mem_trace->cur_req->core_id = core_id;
         mem_trace->cur_req->req_type = req_type;
         mem_trace->cur_req->memory_address = mem_addr;
+        mem_trace->cur_req->migration = false;
+
+        mem_trace->timestamp = (num_tokens > type_idx + 1) ? convToUint64(tokens[type_idx + 1]) :
+                                                             mem_trace->num_reqs;
+        ++mem_trace->num_reqs;
 
         free(line);
         line = NULL;
@@ -50,9 +256,7 @@ bool getRequest(TraceParser *mem_trace)
     // Release memory
     free(line);
 
-    fclose(mem_trace->fd);
-    free(mem_trace->cur_req);
-    free(mem_trace);
+    closeTraceParser(mem_trace);
     return false;
 }
 
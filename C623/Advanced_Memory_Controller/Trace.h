@@ -8,15 +8,56 @@
 
 #include "Request.h"
 
+/*
+ * Multi-trace mix. Each single-program trace gets its own core_id (its position in
+ * the mix) and the traces are merged on the fly with a k-way heap keyed on the next
+ * request of each trace:
+ *   MIX_ROUND_ROBIN: one request of each trace in turn.
+ *   MIX_TIMESTAMP: the smallest timestamp first. The timestamp is the optional last
+ *                  column of a trace line, the position of the line in its trace if absent.
+ *   MIX_RATE: trace i gets weights[i] requests for every one of a weight-1 trace
+ *             (stride scheduling).
+ * Ties go to the trace listed first. A trace line is "[core] addr R|W [timestamp]",
+ * the core column of a single-program trace is ignored.
+ */
+typedef enum Mix_Policy{MIX_ROUND_ROBIN, MIX_TIMESTAMP, MIX_RATE}Mix_Policy;
+
+#define MIX_RATE_STRIDE (1 << 20) // stride of a weight-1 trace
+
+struct Trace_Mix;
+
 typedef struct TraceParser
 {
     FILE *fd; // file descriptor for the trace file
 
     Request *cur_req; // current instruction
+
+    int core_filter; // only replay the requests of this core, -1 for all the cores
+
+    uint64_t num_reqs; // Requests read so far
+    uint64_t timestamp; // Timestamp of cur_req
+
+    struct Trace_Mix *mix; // Traces merged into this one, NULL when reading fd
 }TraceParser;
 
+typedef struct Trace_Mix
+{
+    TraceParser **sources; // One per core, cur_req is the next request of the source
+    unsigned num_sources;
+    Mix_Policy policy;
+
+    uint64_t *keys; // Heap key of each source's next request
+    uint64_t *strides; // MIX_RATE, key increment per request
+
+    unsigned *heap; // Min-heap of the sources not exhausted yet
+    unsigned heap_size;
+}Trace_Mix;
+
 // Define functions
 TraceParser *initTraceParser(const char * mem_file);
+TraceParser *initTraceMix(const char **mem_files, unsigned num_files, Mix_Policy policy,
+                          const unsigned *weights);
+void closeTraceParser(TraceParser *mem_trace);
 bool getRequest(TraceParser *mem_trace);
 uint64_t convToUint64(char *ptr);
 void printMemRequest(Request *req);